@@ -23,6 +23,9 @@
 #include "utils.h"
 #include "SerialProtocol.h"
 #include "RCRcvrPWM.h"
+#include "RCRcvrPWMT1.h"
+#include "RCRcvrPPM.h"
+#include "RCRcvrSBUS.h"
 
 enum {
     STATE_INIT = 0,
@@ -31,16 +34,64 @@ enum {
     STATE_DISCOVERY_ACK,
     STATE_CONFIG,
     STATE_WORK,
+    STATE_RECONNECT,
+    STATE_RESUME,
+};
+
+enum {
+    RCVR_PWM = 0,
+    RCVR_PWM_T1,
+    RCVR_PPM,
+    RCVR_SBUS,          // RX is taken by SBUS, PIN_RCVR_RESET is the way back
+    RCVR_MAX,
 };
 
 #define PIN_LED1    A0
 #define PIN_LED2    A1
 #define PIN_LED3    A2
+#define PIN_BUZZER  A3          // active buzzer, high for on
+#define PIN_RCVR_RESET  A4      // tied to ground at power up : receiver type back to DEFAULT_RCVR
+
+// telemetry from the ESP : battery %, rssi, flying state, alert state, link quality, flags, app count
+#define TELEMETRY_LEN           7
+#define TELEMETRY_UNKNOWN       0xff
+#define TELEMETRY_LINK_UP       0x01
+#define TELEMETRY_TIMEOUT_MS    2000
+
+#define BATT_LOW                20
+#define BATT_CRITICAL           10
+#define QUALITY_LOW             30
+
+#define ALERT_CRITICAL_BATT     3   // drone alert states
+#define ALERT_LOW_BATT          4
+
+// 16 slots of 125ms, a bit set sounds the slot
+#define ALARM_SLOT_MS           125
+#define ALARM_NONE              0x0000
+#define ALARM_LOW_BATT          0x0001  // one beep every 2s
+#define ALARM_LINK              0x0005  // two beeps every 2s
+#define ALARM_CRITICAL_BATT     0x5555  // 4 beeps a second
 
 #define FW_VERSION  0x0120
 
+#define DEFAULT_RCVR    RCVR_PWM
+
+#define EEP_RCVR_TYPE   0
+#define EEP_CURVE       1       // CURVE_CH x CURVE_LEN, erased cells leave the ESP default
+
+// stick curves for the ESP : expo, rate, deadband, trim, reverse
+#define CURVE_CH        8
+#define CURVE_LEN       5
+#define CURVE_PUSH_MS   20      // a channel at a time, the TX ring is 64 bytes
+
 static SerialProtocol  mSerial;
 static RCRcvr *mRcvr = NULL;
+static u8  mState = STATE_INIT;
+static u8  mTelem[TELEMETRY_LEN];
+static u32 mTelemTS;
+static bool mTelemValid;
+static u8  mCurveCh = CURVE_CH;     // next one to push
+static u32 mCurveTS;
 
 
 static void showLED(u8 color)
@@ -50,7 +101,53 @@ static void showLED(u8 color)
     digitalWrite(PIN_LED3, color & 0x04);
 }
 
-static void initReceiver(void)
+static u16 getAlarm(void)
+{
+    u8   batt    = mTelem[0];
+    u8   flying  = mTelem[2];
+    u8   alert   = mTelem[3];
+    bool stale   = millis() - mTelemTS > TELEMETRY_TIMEOUT_MS;
+    bool linkBad = stale || !(mTelem[5] & TELEMETRY_LINK_UP) || mTelem[4] < QUALITY_LOW || mState != STATE_WORK;
+
+    if (!mTelemValid)
+        return ALARM_NONE;
+
+    if ((batt != TELEMETRY_UNKNOWN && batt <= BATT_CRITICAL) || alert == ALERT_CRITICAL_BATT)
+        return ALARM_CRITICAL_BATT;
+
+    // takingoff, hovering, flying, landing
+    if (flying >= 1 && flying <= 4 && linkBad)
+        return ALARM_LINK;
+
+    if ((batt != TELEMETRY_UNKNOWN && batt <= BATT_LOW) || alert == ALERT_LOW_BATT)
+        return ALARM_LOW_BATT;
+
+    return ALARM_NONE;
+}
+
+// battery gauge on the LEDs while working, the state otherwise
+static void updateAlarm(void)
+{
+    u8  slot  = (millis() / ALARM_SLOT_MS) & 0x0f;
+    u16 alarm = getAlarm();
+    u8  batt  = mTelem[0];
+
+    digitalWrite(PIN_BUZZER, (alarm >> slot) & 0x01);
+
+    if (mState != STATE_WORK || !mTelemValid || batt == TELEMETRY_UNKNOWN) {
+        showLED(mState);
+    } else if (batt > 60) {
+        showLED(0x07);
+    } else if (batt > 30) {
+        showLED(0x03);
+    } else if (batt > BATT_LOW) {
+        showLED(0x01);
+    } else {
+        showLED(slot & 0x01);
+    }
+}
+
+static void initReceiver(u8 type)
 {
     // receiver
     if (mRcvr) {
@@ -58,11 +155,61 @@ static void initReceiver(void)
         delete mRcvr;
         mRcvr = NULL;
     }
-    mRcvr = new RCRcvrPWM();
+
+    if (type >= RCVR_MAX)
+        type = DEFAULT_RCVR;
+
+    switch (type) {
+        case RCVR_PWM_T1:
+            mRcvr = new RCRcvrPWMT1();
+            break;
+
+        case RCVR_PPM:
+            mRcvr = new RCRcvrPPM();
+            break;
+
+        case RCVR_SBUS:
+            mRcvr = new RCRcvrSBUS(&mSerial);
+            break;
+
+        default:
+            mRcvr = new RCRcvrPWM();
+            break;
+    }
     if (mRcvr)
         mRcvr->init();
 }
 
+// the ESP keeps no curves, they go again after every state change it reports
+static void pushCurve(void)
+{
+    u8 buf[CURVE_LEN + 1];
+
+    if (mCurveCh >= CURVE_CH || millis() - mCurveTS < CURVE_PUSH_MS)
+        return;
+
+    mCurveTS = millis();
+    buf[0] = mCurveCh;
+    for (u8 i = 0; i < CURVE_LEN; i++)
+        buf[i + 1] = EEPROM.read(EEP_CURVE + mCurveCh * CURVE_LEN + i);
+    mCurveCh++;
+
+    // rate over 100 is an erased channel
+    if (buf[2] <= 100)
+        mSerial.sendCmd(SerialProtocol::CMD_SET_CURVE, buf, sizeof(buf));
+}
+
+// channels followed by the receiver status byte
+static void sendRC(void)
+{
+    u8 buf[RC_MAX_CH * 2 + 1];
+    u8 size = mRcvr->getChCnt() * 2;
+
+    memcpy(buf, mRcvr->getRCs(), size);
+    buf[size++] = mRcvr->getStatus();
+    mSerial.sendCmd(SerialProtocol::CMD_SET_RC, buf, size);
+}
+
 u32 serialCallback(u8 cmd, u8 *data, u8 size)
 {
     u32 id;
@@ -83,8 +230,40 @@ u32 serialCallback(u8 cmd, u8 *data, u8 size)
             break;
 
         case SerialProtocol::CMD_SET_STATE:
+            if (*data != mState)
+                mCurveCh = 0;
+            mState = *data;
             showLED(*data);
             break;
+
+        case SerialProtocol::CMD_SET_TELEMETRY:
+            if (size >= TELEMETRY_LEN) {
+                memcpy(mTelem, data, TELEMETRY_LEN);
+                mTelemTS    = millis();
+                mTelemValid = true;
+            }
+            break;
+
+        case SerialProtocol::CMD_SET_RCVR:
+            if (size >= 1) {
+                if (*data < RCVR_MAX) {
+                    EEPROM.write(EEP_RCVR_TYPE, *data);
+                    initReceiver(*data);
+                }
+                mSerial.sendResponse(*data < RCVR_MAX, cmd, data, 1);
+            }
+            break;
+
+        case SerialProtocol::CMD_SET_CURVE:
+            // ch, expo, rate, deadband, trim, reverse from the bench, the ESP gets it on the next push
+            if (size >= CURVE_LEN + 1) {
+                if (*data < CURVE_CH) {
+                    for (u8 i = 0; i < CURVE_LEN; i++)
+                        EEPROM.write(EEP_CURVE + *data * CURVE_LEN + i, data[i + 1]);
+                }
+                mSerial.sendResponse(*data < CURVE_CH, cmd, data, 1);
+            }
+            break;
     }
     return ret;
 }
@@ -94,13 +273,21 @@ void setup()
     pinMode(PIN_LED1, OUTPUT);
     pinMode(PIN_LED2, OUTPUT);
     pinMode(PIN_LED3, OUTPUT);
+    pinMode(PIN_BUZZER, OUTPUT);
     digitalWrite(PIN_LED1, LOW);
     digitalWrite(PIN_LED2, LOW);
     digitalWrite(PIN_LED3, LOW);
+    digitalWrite(PIN_BUZZER, LOW);
+
+    // a stored SBUS type keeps CMD_SET_RCVR from ever coming in again
+    pinMode(PIN_RCVR_RESET, INPUT_PULLUP);
+    delay(1);
+    if (digitalRead(PIN_RCVR_RESET) == LOW && EEPROM.read(EEP_RCVR_TYPE) != DEFAULT_RCVR)
+        EEPROM.write(EEP_RCVR_TYPE, DEFAULT_RCVR);
 
-    mSerial.begin(57600);
+    mSerial.begin(SERIAL_LINK_BAUD);
     mSerial.setCallback(serialCallback);
-    initReceiver();
+    initReceiver(EEPROM.read(EEP_RCVR_TYPE));
 }
 
 char buf[255];
@@ -109,10 +296,11 @@ void loop()
 {
     mSerial.handleRX();
 #if 1
-    if (mRcvr) {
-        mSerial.sendCmd(SerialProtocol::CMD_SET_RC, (u8*)mRcvr->getRCs(), mRcvr->getChCnt() * 2);
-        delay(20);
+    if (mRcvr && mRcvr->isFrameReady()) {
+        sendRC();
     }
+    pushCurve();
+    updateAlarm();
 #else
     if (mRcvr) {
          sprintf(buf, "%4d %4d %4d %4d %4d %4d %4d %4d\n", mRcvr->getRC(0), mRcvr->getRC(1), mRcvr->getRC(2), mRcvr->getRC(3), mRcvr->getRC(4),
@@ -19,19 +19,99 @@
 #include <avr/pgmspace.h>
 #include "Common.h"
 
+// Timer1 prescaler 8 : 0.5us per tick at 16MHz, 1us at 8MHz
+#define RC_TICKS_PER_US             (F_CPU / 8000000UL)
+#define RC_MIN_TICKS                (1000 * RC_TICKS_PER_US)
+#define RC_MID_TICKS                (1500 * RC_TICKS_PER_US)
+#define RC_MAX_TICKS                (2000 * RC_TICKS_PER_US)
+
+// -100 ~ 100 for 1000 ~ 2000us in 16.16 fixed point
+#define RC_SCALE                    ((65536UL * 100 + 250 * RC_TICKS_PER_US) / (500 * RC_TICKS_PER_US))
+
+// getStatus() flags, sent after the channels of CMD_SET_RC
+#define RC_STATUS_FRAME_LOST        0x01
+#define RC_STATUS_FAILSAFE          0x02
+
+#define RC_MAX_CH                   16
+#define RC_STICK_MASK               0x000f  // throttle, rudder, elevator, aileron
+#define RC_REPORT_MS                20      // report period of receivers without frame sync
+#define RC_SYNC_LOST_MS             50      // frame receivers report stale values after this
+#define RC_FAILSAFE_MS              100     // stick pulse age raising RC_STATUS_FAILSAFE
+
+// pulse width accepted as a live channel
+#define RC_VALID_MIN_US             800
+#define RC_VALID_MAX_US             2200
+
 class RCRcvr 
 {
 
 public:
-    RCRcvr() { };
+    RCRcvr() { mAliveMask = 0; mReportTS = 0; };
+    virtual ~RCRcvr() { };
 
     virtual void init(void);
     virtual void close(void);
     virtual s16  getRC(u8 ch);
     virtual s16 *getRCs(void);
     virtual u8   getChCnt(void);
+    virtual bool isFrameReady(void) { return false; }   // true once per new frame
+    virtual u8   getStatus(void)    { return getAgeStatus(); }
+
+    // ms since the last valid pulse, as of the last report
+    u16 getAge(u8 ch)
+    {
+        return (ch < RC_MAX_CH && (mAliveMask & (1 << ch))) ? (u16)millis() - mPulseTS[ch] : 0xffff;
+    }
+
+    static inline s16 ticksToRC(u16 ticks)
+    {
+        ticks = constrain(ticks, RC_MIN_TICKS, RC_MAX_TICKS);
+        return ((s32)(s16)(ticks - RC_MID_TICKS) * (s32)RC_SCALE + 32768) >> 16;
+    }
+
+protected:
+    // called once per report with the channels updated since the previous one
+    void updateAge(u16 fresh)
+    {
+        u16 now = millis();
+        u16 bit = 1;
+
+        for (u8 i = 0; i < RC_MAX_CH; i++, bit <<= 1) {
+            if (fresh & bit) {
+                mPulseTS[i] = now;
+                mAliveMask |= bit;
+            } else if ((u16)(now - mPulseTS[i]) >= RC_FAILSAFE_MS) {
+                mAliveMask &= ~bit;
+            }
+        }
+    }
+
+    u8 getAgeStatus(void)
+    {
+        return ((mAliveMask & RC_STICK_MASK) == RC_STICK_MASK) ? 0 : RC_STATUS_FAILSAFE;
+    }
+
+    // frame receivers report every frame, and stale values every RC_SYNC_LOST_MS without one
+    bool checkFrame(bool ready, u16 fresh)
+    {
+        u32 ts = millis();
+
+        if (ready)
+            updateAge(fresh);
+        else if (ts - mReportTS >= RC_SYNC_LOST_MS)
+            updateAge(0);
+        else
+            return false;
+
+        mReportTS = ts;
+        return true;
+    }
+
+    u32  mReportTS;
 
 private:
+    u16  mPulseTS[RC_MAX_CH];
+    u16  mAliveMask;
 
 };
 
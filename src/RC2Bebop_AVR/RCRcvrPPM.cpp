@@ -0,0 +1,114 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is derived from deviationTx project for Arduino.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#include "common.h"
+#include "utils.h"
+#include "RCRcvrPPM.h"
+
+#define PIN_PPM                     8       // ICP1, PB0
+
+#define PPM_MAX_CH                  12
+#define PPM_MIN_CH                  4
+#define PPM_CH_SYNC_WAIT            0xff
+
+#define PPM_SYNC_TICKS              (3000 * RC_TICKS_PER_US)
+#define PPM_MIN_TICKS               (750  * RC_TICKS_PER_US)
+#define PPM_MAX_TICKS               (2250 * RC_TICKS_PER_US)
+
+static s16 sRC[PPM_MAX_CH];
+static u16 wLastTS;
+static u8  ucCh = PPM_CH_SYNC_WAIT;
+static volatile u8 ucChCnt;                 // channels per frame, learned at sync
+static volatile u8 ucFrameReady;
+
+s16 RCRcvrPPM::getRC(u8 ch)
+{
+    if (ch >= getChCnt())
+        return -100;
+
+    return sRC[ch];
+}
+
+s16 *RCRcvrPPM::getRCs(void)
+{
+    return sRC;
+}
+
+u8 RCRcvrPPM::getChCnt(void)
+{
+    return ucChCnt;
+}
+
+// the frame is complete on the last channel edge once the channel count is known,
+// sRC is not touched again before the sync gap is over.
+bool RCRcvrPPM::isFrameReady(void)
+{
+    bool ready = ucFrameReady;
+
+    ucFrameReady = 0;
+    return checkFrame(ready, (1 << ucChCnt) - 1);
+}
+
+void RCRcvrPPM::init(void)
+{
+    memset(sRC, 0, sizeof(sRC));
+    sRC[0]       = -100;  // throttle min
+    ucCh         = PPM_CH_SYNC_WAIT;
+    ucChCnt      = 0;
+    ucFrameReady = 0;
+
+    pinMode(PIN_PPM, INPUT_PULLUP);
+
+    // free running, capture rising edges with noise canceler
+    TCCR1A = 0;
+    TCCR1B = BV(ICNC1) | BV(ICES1) | BV(CS11);
+    TIFR1  = BV(ICF1);
+    TIMSK1 = BV(ICIE1);
+}
+
+void RCRcvrPPM::close(void)
+{
+    TIMSK1 &= ~BV(ICIE1);
+    TCCR1B = 0;
+}
+
+ISR(TIMER1_CAPT_vect)
+{
+    u16 wTS   = ICR1;
+    u16 wDiff = wTS - wLastTS;
+
+    wLastTS = wTS;
+
+    if (wDiff >= PPM_SYNC_TICKS) {
+        if (ucCh >= PPM_MIN_CH && ucCh != PPM_CH_SYNC_WAIT && ucCh != ucChCnt) {
+            ucChCnt      = ucCh;
+            ucFrameReady = 1;
+        }
+        ucCh = 0;
+        return;
+    }
+
+    if (ucCh >= PPM_MAX_CH || wDiff < PPM_MIN_TICKS || wDiff > PPM_MAX_TICKS) {
+        ucCh = PPM_CH_SYNC_WAIT;
+        return;
+    }
+
+    sRC[ucCh++] = RCRcvr::ticksToRC(wDiff);
+    if (ucCh == ucChCnt)
+        ucFrameReady = 1;
+}
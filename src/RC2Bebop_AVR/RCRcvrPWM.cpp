@@ -58,6 +58,11 @@ static const PROGMEM u8 TBL_PINS_RX2[] = {
 static u16 wPrevTime[sizeof(TBL_PINS_RX1) + sizeof(TBL_PINS_RX2)];
 static s16 sRC[sizeof(TBL_PINS_RX1) + sizeof(TBL_PINS_RX2)];
 
+// edge handler for receivers sharing the PCINT vectors, ts is TCNT1
+static void (*pfnEdgeHandler)(u8 idx, u16 ts, u8 mask, u8 pins);
+
+volatile u16 RCRcvrPWM::mFreshMask;
+
 s16 RCRcvrPWM::getRC(u8 ch)
 {
     if (ch >= getChCnt())
@@ -76,6 +81,25 @@ u8 RCRcvrPWM::getChCnt(void)
     return sizeof(TBL_PINS_RX1) + sizeof(TBL_PINS_RX2);
 }
 
+// no frame sync on parallel PWM, report at the servo frame rate
+bool RCRcvrPWM::isFrameReady(void)
+{
+    u32 ts = millis();
+    u16 fresh;
+
+    if (ts - mReportTS < RC_REPORT_MS)
+        return false;
+
+    cli();
+    fresh = mFreshMask;
+    mFreshMask = 0;
+    sei();
+
+    updateAge(fresh);
+    mReportTS = ts;
+    return true;
+}
+
 void RCRcvrPWM::init(void)
 {
     memset(sRC, 0, sizeof(sRC));
@@ -103,6 +127,29 @@ void RCRcvrPWM::init(void)
 void RCRcvrPWM::close(void)
 {
     PCICR = ~(PCINT_RX1_IR_BIT | PCINT_RX2_IR_BIT);
+    pfnEdgeHandler = NULL;
+}
+
+void RCRcvrPWM::setEdgeHandler(void (*handler)(u8 idx, u16 ts, u8 mask, u8 pins))
+{
+    pfnEdgeHandler = handler;
+}
+
+// returns the channel wired to bit of PCINT port idx, 0xff if none
+u8 RCRcvrPWM::getChannel(u8 idx, u8 bit)
+{
+    if (idx == PCINT_RX1_IDX) {
+        for (u8 i = 0; i < sizeof(TBL_PINS_RX1); i++) {
+            if (pgm_read_byte(TBL_PINS_RX1 + i) == bit)
+                return i;
+        }
+    } else {
+        for (u8 i = 0; i < sizeof(TBL_PINS_RX2); i++) {
+            if (pgm_read_byte(TBL_PINS_RX2 + i) - 8 == bit)
+                return sizeof(TBL_PINS_RX1) + i;
+        }
+    }
+    return 0xff;
 }
 
 void calcPeriod(u8 idx, u16 ts, u8 mask, u8 pins)
@@ -130,7 +177,10 @@ void calcPeriod(u8 idx, u16 ts, u8 mask, u8 pins)
         bv = BV(pgm_read_byte(tbl + i) - bit);
         if (mask & bv) {
             if (!(pins & bv)) {
-                wDiff  = constrain(ts - wPrevTime[start + i], 1000, 2000);
+                wDiff  = ts - wPrevTime[start + i];
+                if (RC_VALID_MIN_US <= wDiff && wDiff <= RC_VALID_MAX_US)
+                    RCRcvrPWM::mFreshMask |= BV(start + i);
+                wDiff  = constrain(wDiff, 1000, 2000);
                 sRC[start + i] = map(wDiff, 1000, 2000, -100, 100);
 //                if (idx == PCINT_RX1_IDX && (i == 1 || i == 3))
 //                    sRC[start + i] = -sRC[start + i];
@@ -148,11 +198,17 @@ ISR(PCINT_RX1)
     u16 wTS;
     static u8 ucLastPin;
 
+    wTS       = TCNT1;
     pins      = PCINT_RX1_PINS;
     mask      = pins ^ ucLastPin;
-    wTS       = micros();
     ucLastPin = pins;
 
+    if (pfnEdgeHandler) {
+        (*pfnEdgeHandler)(PCINT_RX1_IDX, wTS, mask, pins);
+        return;
+    }
+
+    wTS = micros();
     sei();
     calcPeriod(PCINT_RX1_IDX, wTS, mask, pins);
 }
@@ -164,11 +220,17 @@ ISR(PCINT_RX2)
     u16 wTS;
     static u8 ucLastPin;
 
+    wTS       = TCNT1;
     pins      = PCINT_RX2_PINS;
     mask      = pins ^ ucLastPin;
-    wTS       = micros();
     ucLastPin = pins;
 
+    if (pfnEdgeHandler) {
+        (*pfnEdgeHandler)(PCINT_RX2_IDX, wTS, mask, pins);
+        return;
+    }
+
+    wTS = micros();
     sei();
     calcPeriod(PCINT_RX2_IDX, wTS, mask, pins);
 }
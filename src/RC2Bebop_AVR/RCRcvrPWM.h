@@ -33,6 +33,14 @@ public:
     virtual s16  getRC(u8 ch);
     virtual s16 *getRCs(void);
     virtual u8   getChCnt(void);
+    virtual bool isFrameReady(void);
+
+    static void  setEdgeHandler(void (*handler)(u8 idx, u16 ts, u8 mask, u8 pins));
+
+    static volatile u16 mFreshMask;     // channels with a valid pulse, set by edge handlers
+
+protected:
+    u8   getChannel(u8 idx, u8 bit);
 
 private:
 
@@ -0,0 +1,99 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is derived from deviationTx project for Arduino.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#include "common.h"
+#include "utils.h"
+#include "RCRcvrPWMT1.h"
+
+#define MAX_CH                      8
+#define CH_NONE                     0xff
+
+#define PWM_VALID_MIN_TICKS         (RC_VALID_MIN_US * RC_TICKS_PER_US)
+#define PWM_VALID_MAX_TICKS         (RC_VALID_MAX_US * RC_TICKS_PER_US)
+
+static u8  ucPinMask[2];
+static u8  ucChMap[2][8];
+static u16 wRiseTS[MAX_CH];
+static s16 sRC[MAX_CH];
+
+static void calcPeriodT1(u8 idx, u16 ts, u8 mask, u8 pins)
+{
+    u8  *map = ucChMap[idx];
+    u8  ch;
+    u16 width;
+
+    mask &= ucPinMask[idx];
+    for (; mask; mask >>= 1, pins >>= 1, map++) {
+        if (!(mask & 0x01))
+            continue;
+
+        ch = *map;
+        if (pins & 0x01) {
+            wRiseTS[ch] = ts;
+        } else {
+            width = ts - wRiseTS[ch];
+            if (PWM_VALID_MIN_TICKS <= width && width <= PWM_VALID_MAX_TICKS)
+                RCRcvrPWM::mFreshMask |= BV(ch);
+            sRC[ch] = RCRcvr::ticksToRC(width);
+        }
+    }
+}
+
+s16 RCRcvrPWMT1::getRC(u8 ch)
+{
+    if (ch >= getChCnt())
+        return -100;
+
+    return sRC[ch];
+}
+
+s16 *RCRcvrPWMT1::getRCs(void)
+{
+    return sRC;
+}
+
+void RCRcvrPWMT1::init(void)
+{
+    memset(sRC, 0, sizeof(sRC));
+    sRC[0] = -100;  // throttle min
+
+    for (u8 idx = 0; idx < 2; idx++) {
+        ucPinMask[idx] = 0;
+        for (u8 bit = 0; bit < 8; bit++) {
+            u8 ch = getChannel(idx, bit);
+
+            ucChMap[idx][bit] = ch;
+            if (ch != CH_NONE)
+                ucPinMask[idx] |= BV(bit);
+        }
+    }
+
+    // free running, no timer interrupts
+    TCCR1A = 0;
+    TCCR1B = BV(CS11);
+    TIMSK1 = 0;
+
+    setEdgeHandler(calcPeriodT1);
+    RCRcvrPWM::init();
+}
+
+void RCRcvrPWMT1::close(void)
+{
+    RCRcvrPWM::close();
+    TCCR1B = 0;
+}
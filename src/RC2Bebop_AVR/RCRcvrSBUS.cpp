@@ -0,0 +1,155 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is derived from deviationTx project for Arduino.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#include "common.h"
+#include "utils.h"
+#include "RCRcvrSBUS.h"
+
+#define SBUS_CH                     16
+#define SBUS_FRAME_SIZE             25
+#define SBUS_START_BYTE             0x0F
+#define SBUS_END_BYTE               0x00
+#define SBUS2_END_BYTE              0x04    // 0x04, 0x14, 0x24, 0x34
+#define SBUS_FLAG_FRAME_LOST        0x04
+#define SBUS_FLAG_FAILSAFE          0x08
+
+// byte time is 120us, frames are 3ms long and 7/14ms apart
+#define SBUS_GAP_TICKS              (500 * RC_TICKS_PER_US)
+
+// 172 ~ 1811 is 988 ~ 2012us, -100 ~ 100 in 16.16 fixed point
+#define SBUS_MID                    992
+#define SBUS_SCALE                  ((65536UL * 100 + 410) / 820)
+
+static u8  ucFrame[SBUS_FRAME_SIZE];
+static u8  ucIdx;
+static u16 wLastTS;
+static s16 sRC[SBUS_CH];
+static volatile u8 ucStatus;
+static volatile u8 ucFrameReady;
+
+static inline s16 sbusToRC(u16 raw)
+{
+    s16 v = ((s32)(s16)(raw - SBUS_MID) * (s32)SBUS_SCALE + 32768) >> 16;
+
+    return constrain(v, -100, 100);
+}
+
+static void decodeFrame(void)
+{
+    u8  *data = &ucFrame[1];
+    u32 bits  = 0;
+    u8  cnt   = 0;
+
+    // 16 x 11 bit channels, LSB first
+    for (u8 ch = 0; ch < SBUS_CH; ch++) {
+        while (cnt < 11) {
+            bits |= (u32)*data++ << cnt;
+            cnt  += 8;
+        }
+        sRC[ch] = sbusToRC(bits & 0x7ff);
+        bits  >>= 11;
+        cnt    -= 11;
+    }
+
+    ucStatus = 0;
+    if (ucFrame[23] & SBUS_FLAG_FRAME_LOST)
+        ucStatus |= RC_STATUS_FRAME_LOST;
+    if (ucFrame[23] & SBUS_FLAG_FAILSAFE)
+        ucStatus |= RC_STATUS_FAILSAFE;
+}
+
+static void sbusRx(u8 data, u8 status)
+{
+    u16 wTS = TCNT1;
+
+    if ((u16)(wTS - wLastTS) >= SBUS_GAP_TICKS)
+        ucIdx = 0;
+    wLastTS = wTS;
+
+    if (status & (BV(FE0) | BV(DOR0) | BV(UPE0))) {
+        ucIdx = SBUS_FRAME_SIZE;            // drop until next gap
+        return;
+    }
+
+    if (ucIdx >= SBUS_FRAME_SIZE || (ucIdx == 0 && data != SBUS_START_BYTE))
+        return;
+
+    ucFrame[ucIdx++] = data;
+    if (ucIdx == SBUS_FRAME_SIZE) {
+        if (data != SBUS_END_BYTE && (data & 0x0f) != SBUS2_END_BYTE)
+            return;
+        decodeFrame();
+        ucFrameReady = 1;
+    }
+}
+
+s16 RCRcvrSBUS::getRC(u8 ch)
+{
+    if (ch >= getChCnt())
+        return -100;
+
+    return sRC[ch];
+}
+
+s16 *RCRcvrSBUS::getRCs(void)
+{
+    return sRC;
+}
+
+u8 RCRcvrSBUS::getChCnt(void)
+{
+    return SBUS_CH;
+}
+
+bool RCRcvrSBUS::isFrameReady(void)
+{
+    bool ready = ucFrameReady;
+
+    ucFrameReady = 0;
+    // channels are not live while the receiver outputs its failsafe values
+    return checkFrame(ready, (ucStatus & RC_STATUS_FAILSAFE) ? 0 : 0xffff);
+}
+
+u8 RCRcvrSBUS::getStatus(void)
+{
+    return ucStatus | getAgeStatus();
+}
+
+void RCRcvrSBUS::init(void)
+{
+    memset(sRC, 0, sizeof(sRC));
+    sRC[0]       = -100;  // throttle min
+    ucIdx        = SBUS_FRAME_SIZE;
+    ucStatus     = RC_STATUS_FRAME_LOST;
+    ucFrameReady = 0;
+
+    // free running for inter frame gap detection
+    TCCR1A = 0;
+    TCCR1B = BV(CS11);
+    TIMSK1 = 0;
+
+    mSerial->begin(SERIAL_LINK_BAUD_SBUS, SERIAL_8E2);
+    mSerial->setRxHandler(sbusRx);
+}
+
+void RCRcvrSBUS::close(void)
+{
+    mSerial->setRxHandler(NULL);
+    mSerial->begin(SERIAL_LINK_BAUD);
+    TCCR1B = 0;
+}
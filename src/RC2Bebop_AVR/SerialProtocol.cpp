@@ -32,6 +32,7 @@ struct ringBuf {
 struct ringBuf mRxRingBuf = { {0}, 0, 0 };
 struct ringBuf mTxRingBuf = { {0}, 0, 0 };
 static u8 chkSumTX;
+static void (*pfnRxHandler)(u8 data, u8 status);
 
 void putChar(struct ringBuf *buf, u8 data)
 {
@@ -73,6 +74,11 @@ u8 available(struct ringBuf *buf)
 
 ISR(USART_RX_vect)
 {
+    if (pfnRxHandler) {
+        u8 status = UCSR0A;
+        (*pfnRxHandler)(UDR0, status);
+        return;
+    }
     putChar(&mRxRingBuf, UDR0);
 }
 
@@ -102,7 +108,7 @@ SerialProtocol::~SerialProtocol()
     UCSR0B &= ~((1<<RXEN0)|(1<<TXEN0)|(1<<RXCIE0)|(1<<UDRIE0));
 }
 
-void SerialProtocol::begin(u32 baud)
+void SerialProtocol::begin(u32 baud, u8 config)
 {
     u8 h = ((F_CPU  / 4 / baud -1) / 2) >> 8;
     u8 l = ((F_CPU  / 4 / baud -1) / 2);
@@ -120,7 +126,15 @@ void SerialProtocol::begin(u32 baud)
     UBRR0H = h;
     UBRR0L = l;
     UCSR0B |= (1<<RXEN0)|(1<<TXEN0)|(1<<RXCIE0);
-    UCSR0C = (1<<UCSZ00) | (1<<UCSZ01);
+    UCSR0C = config;
+    sei();
+}
+
+// bytes go to handler instead of the protocol parser, status is UCSR0A
+void SerialProtocol::setRxHandler(void (*handler)(u8 data, u8 status))
+{
+    cli();
+    pfnRxHandler = handler;
     sei();
 }
 
@@ -19,7 +19,10 @@
 #include "utils.h"
 #include <stdarg.h>
 
-#define MAX_PACKET_SIZE 32
+#define MAX_PACKET_SIZE 40
+
+#define SERIAL_LINK_BAUD        57600
+#define SERIAL_LINK_BAUD_SBUS   100000      // 8E2, USART RX is taken by the SBUS receiver
 
 class SerialProtocol
 {
@@ -30,13 +33,17 @@ public:
         CMD_SET_RC,
         CMD_SET_STATE,
         CMD_GET_FREE_RAM,
+        CMD_SET_RCVR,
+        CMD_SET_CURVE,
+        CMD_SET_TELEMETRY,
         CMD_TEST = 110,
     } CMD_T;
 
     SerialProtocol();
     ~SerialProtocol();
 
-    void begin(u32 baud);
+    void begin(u32 baud, u8 config = SERIAL_8N1);
+    void setRxHandler(void (*handler)(u8 data, u8 status));
     void handleRX(void);
     void sendCmd(u8 cmd, u8 *data, u8 size);
     void sendResponse(bool ok, u8 cmd, u8 *data, u8 size);
@@ -19,10 +19,40 @@
 #include "Utils.h"
 #include "ByteBuffer.h"
 
-BridgeServer::BridgeServer(char *name, int portServer)
+#define PCMD_PERIOD_MS          25
+#define APP_PCMD_TIMEOUT_MS     100     // app stopped piloting, kick() takes over
+#define RC_ACTIVE_HOLD_MS       1000    // keep RC in control after the sticks are centered
+
+// PCMD body : prj, cls, cmd(2), flag, roll, pitch, yaw, gaz, ts(4)
+#define PCMD_BODY_LEN           13
+#define PCMD_FLAG_POS           4
+
+BridgeServer::BridgeServer(char *name, int portServer) : mTx(&mUDPHost)
 {
     mName       = name;
     mBypass     = false;
+    mEnRollPitch = 0;
+    mRoll       = 0;
+    mPitch      = 0;
+    mYaw        = 0;
+    mGaz        = 0;
+    mMixPolicy  = MIX_APP_ONLY;
+    mRCActiveTS = 0;
+    mAppPCMDTS  = 0;
+    mTapCallback = NULL;
+    mLink       = NULL;
+    mVideo      = NULL;
+    mClock      = NULL;
+    mStats      = NULL;
+    mCache      = NULL;
+    mRec        = NULL;
+    mSplice     = NULL;
+    mPCMDSplice = NULL;
+    mDir        = Stats::DIR_C2D;
+    mHostPort   = 0;
+    mSourceIP   = 0;
+    mSubCnt     = 0;
+    mDecimSink  = 0;
 }
 
 BridgeServer::~BridgeServer()
@@ -30,30 +60,480 @@ BridgeServer::~BridgeServer()
     mUDPHost.stop();
 }
 
+void BridgeServer::setDest(IPAddress hostIP, int hostport)
+{
+    flush();
+    mSubCnt = 0;
+    addSubscriber(hostIP, hostport);
+}
+
+// an app already in the table only moves its port. when full the last one is replaced
+int BridgeServer::addSubscriber(IPAddress ip, int port, u8 filter, u32 rate)
+{
+    SUB_T   *sub;
+    int     idx;
+
+    for (idx = 0; idx < mSubCnt; idx++) {
+        if (mSubs[idx].ip == (u32)ip) {
+            mSubs[idx].port = port;
+            if (idx == 0)
+                mHostPort = port;
+            return idx;
+        }
+    }
+
+    flush();
+    idx = (mSubCnt < BRG_MAX_SUBS) ? mSubCnt++ : BRG_MAX_SUBS - 1;
+    sub = &mSubs[idx];
+    memset(sub, 0, sizeof(SUB_T));
+    sub->ip     = ip;
+    sub->port   = port;
+    sub->rate   = rate;
+    sub->tokens = TX_BATCH_MTU;
+    sub->ts     = millis();
+    memset(sub->filter, 0xff, sizeof(sub->filter));
+
+    switch (filter) {
+        case SUB_NO_VIDEO:
+            setSubscriberFilter(idx, BUFFER_ID_D2C_VID, false);
+            break;
+
+        case SUB_TELEMETRY:
+            memset(sub->filter, 0, sizeof(sub->filter));
+            setSubscriberFilter(idx, BUFFER_ID_D2C_RPT, true);
+            setSubscriberFilter(idx, BUFFER_ID_D2C_ACK_SETTINGS, true);
+            break;
+    }
+
+    if (idx == 0) {
+        mHostIP   = ip;
+        mHostPort = port;
+    }
+    Utils::printf("%s subscriber %d : %s:%d filter:%d rate:%d\n", mName, idx, ip.toString().c_str(), port, filter, rate);
+
+    return idx;
+}
+
+void BridgeServer::removeSubscriber(IPAddress ip)
+{
+    for (int idx = 0; idx < mSubCnt; idx++) {
+        if (mSubs[idx].ip == (u32)ip) {
+            flush();
+            memmove(&mSubs[idx], &mSubs[idx + 1], (mSubCnt - idx - 1) * sizeof(SUB_T));
+            mSubCnt--;
+            mHostPort = mSubCnt ? mSubs[0].port : 0;
+            mHostIP   = IPAddress(mSubCnt ? mSubs[0].ip : 0);
+            return;
+        }
+    }
+}
+
+void BridgeServer::setSubscriberFilter(int idx, u8 id, bool pass)
+{
+    if (idx < 0 || idx >= mSubCnt)
+        return;
+
+    if (pass)
+        mSubs[idx].filter[id >> 5] |= (1UL << (id & 0x1f));
+    else
+        mSubs[idx].filter[id >> 5] &= ~(1UL << (id & 0x1f));
+}
+
 void BridgeServer::sendto(u8 *data, int size)
 {
     //Utils::printf("<<< TX : %s to (%s:%d)\n", 
     //    mName, mHostIP.toString().c_str(), mHostPort);
 
-    if (mHostIP[0] == 0) {
-        Utils::printf("<<< TX ERROR : no dest\n");
-        return;
+    if (!mTx.fits(size))
+        flush();
+    mTx.add(data, size);
+}
+
+bool BridgeServer::isDecimated(u8 *frame, u16 len)
+{
+    return frame[1] == BUFFER_ID_D2C_RPT && len >= CLASSIFY_LEN &&
+        mDecim->isKey(PACK_CMD(frame[7], frame[8], Utils::get16(&frame[9])));
+}
+
+// token bucket in bytes, a burst of a datagram or a quarter second
+bool BridgeServer::admit(u8 idx, u8 *frame, u16 len, u32 ts)
+{
+    SUB_T   *sub = &mSubs[idx];
+    u8      id = frame[1];
+
+    if (!(sub->filter[id >> 5] & (1UL << (id & 0x1f))))
+        return false;
+
+    // the watching apps get those from the decimator
+    if (idx > 0 && mDecim && isDecimated(frame, len))
+        return false;
+
+    if (sub->rate) {
+        s32 burst = max((s32)(sub->rate / 4), (s32)TX_BATCH_MTU);
+
+        u64 tokens = sub->tokens + (u64)sub->rate * (ts - sub->ts) / 1000;
+
+        sub->tokens = (tokens > (u64)burst) ? burst : (s32)tokens;
+        sub->ts     = ts;
+        if (sub->tokens < len) {
+            sub->drops++;
+            return false;
+        }
+        sub->tokens -= len;
     }
+    sub->frames++;
+
+    return true;
+}
 
-    mUDPHost.beginPacket(mHostIP, mHostPort);
-    mUDPHost.write(data, size);
+// a datagram of its own, out of the batch
+void BridgeServer::sendSub(SUB_T *sub, u8 *frame, u16 size)
+{
+    mUDPHost.beginPacket(IPAddress(sub->ip), sub->port);
+    mUDPHost.write(frame, size);
     mUDPHost.endPacket();
+    if (mCap)
+        mCap->add(Capture::getLocalIP(sub->ip), mUDPHost.localPort(), sub->ip, sub->port, frame, size);
+    sub->frames++;
 }
 
-int BridgeServer::preProcess(u8 *data, u32 size, u8 *dataAck)
+void BridgeServer::deliver(u8 sink, u8 *frame, u8 size)
 {
-    if (mBypass) {
-        if (mHostPort != 0) {
-            sendto(mBuffer, mPayloadLen);
-        } else {
-            Utils::printf("HOST PORT IS ZERO !!!\n");
+    u8 idx = sink - mDecimSink + 1;
+
+    if (sink < mDecimSink || idx >= mSubCnt)
+        return;
+
+    SUB_T   *sub = &mSubs[idx];
+    u8      id = frame[1];
+
+    if (!(sub->filter[id >> 5] & (1UL << (id & 0x1f))))
+        return;
+
+    sendSub(sub, frame, size);
+}
+
+// for one app only, dropped when it is gone
+void BridgeServer::sendApp(u32 ip, u8 *frame, u16 size)
+{
+    for (u8 i = 0; i < mSubCnt; i++) {
+        if (mSubs[i].ip == ip) {
+            sendSub(&mSubs[i], frame, size);
+            return;
+        }
+    }
+}
+
+// the batch is built once, each subscriber gets the frames it takes out of the same buffer
+void BridgeServer::flush(void)
+{
+    u32 ts = millis();
+
+    if (mTx.isEmpty())
+        return;
+
+    for (u8 i = 0; i < mSubCnt; i++) {
+        SUB_T *sub = &mSubs[i];
+        bool  open = false;
+
+        for (u8 j = 0; j < mTx.getFrameCnt(); j++) {
+            u16 len;
+            u8  *frame = mTx.getFrame(j, &len);
+
+            if (!admit(i, frame, len, ts))
+                continue;
+            if (!open) {
+                mUDPHost.beginPacket(IPAddress(sub->ip), sub->port);
+                if (mCap)
+                    mCap->open(Capture::getLocalIP(sub->ip), mUDPHost.localPort(), sub->ip, sub->port);
+                open = true;
+            }
+            mUDPHost.write(frame, len);
+            if (mCap)
+                mCap->append(frame, len);
         }
-        return -mPayloadLen;;
+        if (open) {
+            mUDPHost.endPacket();
+            if (mCap)
+                mCap->commit();
+        }
+    }
+    mTx.clear();
+}
+
+// everything forwarded from one received datagram leaves as one datagram
+int BridgeServer::process(u8 *dataAck)
+{
+    int size = NavServer::process(dataAck);
+
+    // the app side bridge plays the cached states back to the app that asked
+    if (mCache && mDir == Stats::DIR_D2C && mBypass) {
+        u8  buf[HEADER_LEN + 256];
+        int len;
+
+        while ((len = mCache->pump(buf, sizeof(buf))) > 0)
+            sendApp(mCache->getAppIP(), buf, len);
+    }
+
+    flush();
+    return size;
+}
+
+bool BridgeServer::isAppActive(long ts)
+{
+    return mAppPCMDTS != 0 && (ts - mAppPCMDTS < APP_PCMD_TIMEOUT_MS);
+}
+
+bool BridgeServer::isRCInControl(long ts)
+{
+    if (mMixPolicy == MIX_APP_ONLY || isFailsafe() || !mFailsafe.isRCAlive(ts))
+        return false;
+    if (mMixPolicy == MIX_RC_ACTIVE)
+        return (ts - mRCActiveTS < RC_ACTIVE_HOLD_MS);
+    return true;
+}
+
+// rewrite the sticks of the app PCMD in the receive buffer, seq and timestamp are kept
+void BridgeServer::mixPCMD(u8 *data)
+{
+    long ts = millis();
+
+    mAppPCMDTS = ts;
+    if (isRCInControl(ts)) {
+        data[PCMD_FLAG_POS]     = mEnRollPitch;
+        data[PCMD_FLAG_POS + 1] = mRoll;
+        data[PCMD_FLAG_POS + 2] = mPitch;
+        data[PCMD_FLAG_POS + 3] = mYaw;
+        data[PCMD_FLAG_POS + 4] = mGaz;
+    }
+    if (mRec)
+        mRec->addPCMD(Recorder::PCMD_APP, data[PCMD_FLAG_POS], data[PCMD_FLAG_POS + 1], data[PCMD_FLAG_POS + 2],
+            data[PCMD_FLAG_POS + 3], data[PCMD_FLAG_POS + 4]);
+}
+
+// feeds our pongs and the rssi report to the link estimator, true when the frame is ours
+bool BridgeServer::probeLink(u8 *data, u32 size)
+{
+    if (mFrameID == BUFFER_ID_PONG)
+        return mLink->onPong(data, size);
+
+    if (mFrameID == BUFFER_ID_D2C_RPT && size >= 6 && data[0] == PROJECT_COMMON &&
+        data[1] == COMMON_CLASS_COMMONSTATE && Utils::get16(&data[2]) == 7)
+        mLink->onRSSI(Utils::get16(&data[4]));
+
+    return false;
+}
+
+// drops video fragments while throttled and keeps the app from turning the stream back on
+bool BridgeServer::throttleVideo(u8 *data, u32 size)
+{
+    if (mFrameID == BUFFER_ID_D2C_VID && mFrameType == FRAME_TYPE_DATA_LOW_LATENCY)
+        return mVideo->onVideoFrag(data, size);
+
+    if (mFrameID == BUFFER_ID_C2D_SETTINGS && size >= 5 && data[0] == PROJECT_ARDRONE3 &&
+        data[1] == ARDRONE3_CLASS_MEDIASTREAMING && Utils::get16(&data[2]) == 0)
+        mVideo->onAppVideoEnable(&data[4]);
+
+    return false;
+}
+
+// drone pings carry the drone clock, date / time commands and reports carry the wall clock
+void BridgeServer::watchClock(u8 *data, u32 size)
+{
+    // app pings on the command bridge carry the app clock
+    if (mFrameID == BUFFER_ID_PING) {
+        if (mDir == Stats::DIR_D2C)
+            mClock->onDronePing(data, size, mLink ? mLink->getRTT() : 0);
+        return;
+    }
+
+    if (size < 6 || data[size - 1] != 0)
+        return;
+
+    u16 cmd = Utils::get16(&data[2]);
+    if (mFrameID == BUFFER_ID_C2D_SETTINGS && data[0] == PROJECT_COMMON && data[1] == COMMON_CLASS_COMMON) {
+        if (cmd == 1)
+            mClock->setDate((char*)&data[4], ClockSync::WALL_APP);
+        else if (cmd == 2)
+            mClock->setTime((char*)&data[4], ClockSync::WALL_APP);
+    } else if (mFrameID == BUFFER_ID_D2C_ACK_SETTINGS && data[0] == PROJECT_COMMON && data[1] == COMMON_CLASS_COMMONSTATE) {
+        if (cmd == 4)
+            mClock->setDate((char*)&data[4], ClockSync::WALL_DRONE);
+        else if (cmd == 5)
+            mClock->setTime((char*)&data[4], ClockSync::WALL_DRONE);
+    }
+}
+
+// true when the frame is consumed or held back by the state cache
+bool BridgeServer::cacheFrame(u8 *data, u32 size)
+{
+    if (mDir == Stats::DIR_D2C) {
+        if (mFrameID != BUFFER_ID_D2C_ACK_SETTINGS || mFrameType != FRAME_TYPE_DATA_WITH_ACK)
+            return false;
+
+        // older than what the cache holds
+        if (mSeqState != SeqTracker::SEQ_DUP && mSeqState != SeqTracker::SEQ_STALE)
+            mCache->record(data, size);
+
+        // not acked by anybody while the replay runs, the drone sends it again
+        if (mCache->isReplaying())
+            return true;
+
+        mBuffer[2] = mCache->shiftSeq(mBuffer[2]);
+        return false;
+    }
+
+    if (mFrameType == FRAME_TYPE_ACK && mFrameID == (0x80 | BUFFER_ID_D2C_ACK_SETTINGS) && size >= 1)
+        return mCache->onAppAck(&data[0]);
+
+    if (mFrameType == FRAME_TYPE_DATA_WITH_ACK && mFrameID == BUFFER_ID_C2D_SETTINGS)
+        return mCache->onAppRequest(data, size, mFrameSeqID, mUDP.remoteIP());
+
+    return false;
+}
+
+// app frames on the spliced buffer move past ours, the drone acks of them move back.
+// true for the ack of one of our frames, it goes to the ack callback instead of the app
+bool BridgeServer::spliceSeq(SeqSplice *splice)
+{
+    u8 id = splice->getID();
+
+    if (mDir == Stats::DIR_C2D && mFrameID == id && mFrameType != FRAME_TYPE_ACK) {
+        mBuffer[2] = splice->onAppFrame(mBuffer[2]);
+    } else if (mDir == Stats::DIR_D2C && mFrameType == FRAME_TYPE_ACK && mFrameID == (0x80 | id) && mPayloadLen > HEADER_LEN) {
+        if (splice->isOwnAck(mBuffer[HEADER_LEN])) {
+            if (mAckCallback)
+                (*mAckCallback)(id, mBuffer[HEADER_LEN]);
+            return true;
+        }
+        mBuffer[HEADER_LEN] = splice->onDroneAck(mBuffer[HEADER_LEN]);
+    }
+    return false;
+}
+
+void BridgeServer::badFrame(void)
+{
+    if (mStats)
+        mStats->addMalformed(mDir);
+}
+
+int BridgeServer::preProcess(u8 *data, u32 size, u8 *dataAck)
+{
+    // a retransmit takes the same way for the peer to ack again, nothing to learn from it
+    bool dup = (mSeqState == SeqTracker::SEQ_DUP || mSeqState == SeqTracker::SEQ_STALE);
+
+    // only the pilot app talks to the drone, the watching ones are not answered
+    if (mSourceIP && (u32)mUDP.remoteIP() != mSourceIP)
+        return PRE_CONSUMED;
+
+    if (mStats) {
+        mStats->addFrame(mDir, mFrameType, mFrameID, mFrameSeqID, mPayloadLen);
+        mStats->addSeq(mDir, mFrameID, mSeqState, mSeq.getGap());
+        if (mFrameType == FRAME_TYPE_ACK && size >= 1)
+            mStats->addAck(mDir, mFrameID, data[0]);
+    }
+
+    if (mBypass && mCache && cacheFrame(data, size))
+        return PRE_CONSUMED;
+
+    if (mClock && !dup)
+        watchClock(data, size);
+
+    // our pongs feed the estimator in any state, only the bypass keeps them from the parser
+    if (mLink && !dup && probeLink(data, size) && mBypass)
+        return PRE_CONSUMED;
+
+    if (!mBypass) {
+        // the parser takes it from here, the tap still sees it
+        if (mTapCallback && !dup && FrameClassifier::classify(mBuffer, sizeof(mBuffer), true) == FrameClassifier::ACT_TAP)
+            (*mTapCallback)(mBuffer, mPayloadLen);
+        return PRE_PARSE;
+    }
+
+    // latest sample kept for the slow sinks, the frame still goes to the pilot app
+    if (mDecim && !dup && mFrameID == BUFFER_ID_D2C_RPT && size >= 4)
+        mDecim->put(PACK_CMD(data[0], data[1], Utils::get16(&data[2])), mBuffer, mPayloadLen);
+
+    if (mVideo && throttleVideo(data, size))
+        return PRE_CONSUMED;
+
+    switch (FrameClassifier::classify(mBuffer, sizeof(mBuffer), mTapCallback != NULL)) {
+        case FrameClassifier::ACT_DROP:
+            badFrame();
+            return PRE_CONSUMED;
+
+        case FrameClassifier::ACT_REWRITE:
+            if (size >= PCMD_BODY_LEN)
+                mixPCMD(data);
+            break;
+
+        case FrameClassifier::ACT_TAP:
+            if (!dup)
+                (*mTapCallback)(mBuffer, mPayloadLen);
+            break;
+    }
+
+    if (mSplice && spliceSeq(mSplice))
+        return PRE_CONSUMED;
+    if (mPCMDSplice)
+        spliceSeq(mPCMDSplice);
+
+    if (mHostPort != 0) {
+        sendto(mBuffer, mPayloadLen);
+    } else {
+        Utils::printf("HOST PORT IS ZERO !!!\n");
+    }
+    return PRE_CONSUMED;
+}
+
+void BridgeServer::move(u8 enRollPitch, s8 roll, s8 pitch, s8 yaw, s8 gaz)
+{
+    u32 ts = millis();
+
+    mEnRollPitch = enRollPitch;
+    mRoll  = roll;
+    mPitch = pitch;
+    mYaw   = yaw;
+    mGaz   = gaz;
+    mFailsafe.onRC(ts);
+    if (roll || pitch || yaw || gaz)
+        mRCActiveTS = ts;
+}
+
+// runs every PCMD tick, the reaction goes out on the tick failsafe is detected
+void BridgeServer::checkFailsafe(long ts)
+{
+    u8   buf[20];
+    int  size = 0;
+    u16  ticks = mFailsafe.getTicks();
+
+    // the RC never flies under APP_ONLY, losing it is no reason to act
+    u8   send = mFailsafe.tick(ts, mMixPolicy == MIX_APP_ONLY || isAppActive(ts));
+
+    if (ticks > 0 && !mFailsafe.isOn())
+        Utils::printf("FAILSAFE off after %d ticks\n", ticks);
+    else if (ticks == 0 && mFailsafe.isOn())
+        Utils::printf("FAILSAFE on, action : %d\n", mFailsafe.getAction());
+
+    switch (send) {
+        case Failsafe::SEND_LAND:
+            size = Bebop::buildCmd(buf, FRAME_TYPE_DATA, BUFFER_ID_C2D_SETTINGS, "BBH", PROJECT_ARDRONE3, ARDRONE3_CLASS_PILOTING, 3);
+            break;
+
+        case Failsafe::SEND_HOME:
+            size = Bebop::buildCmd(buf, FRAME_TYPE_DATA, BUFFER_ID_C2D_SETTINGS, "BBHB", PROJECT_ARDRONE3, ARDRONE3_CLASS_PILOTING, 5, 1);
+            break;
+
+        case Failsafe::SEND_HOME_CANCEL:
+            size = Bebop::buildCmd(buf, FRAME_TYPE_DATA, BUFFER_ID_C2D_SETTINGS, "BBHB", PROJECT_ARDRONE3, ARDRONE3_CLASS_PILOTING, 5, 0);
+            break;
+    }
+
+    if (size > 0) {
+        // in the app seq space while it has one on the buffer
+        if (mSplice)
+            mSplice->stamp(buf);
+        sendto(buf, size);
     }
 }
 
@@ -63,15 +543,57 @@ int BridgeServer::kick(void)
     int  diff = ts - mLastTS;
     int  size = 0;
 
-    if (diff >= 25) {
-        u8  flag = 0;
-        u32 tsPCMD = (mPCMDSeq++ << 24) | (millis() & 0x00ffffff);
+    if (mTx.isDue())
+        flush();
+    if (mLink && mLink->isPingDue(ts)) {
+        u8 buf[20];
+
+        sendto(buf, mLink->buildPing(buf));
+    }
+
+    if (mVideo) {
+        s8 enable = mVideo->update(ts, mLink);
+
+        if (enable >= 0) {
+            u8 buf[20];
+
+            size = Bebop::buildCmd(buf, FRAME_TYPE_DATA, BUFFER_ID_C2D_SETTINGS, "BBHB", PROJECT_ARDRONE3, ARDRONE3_CLASS_MEDIASTREAMING, 0, enable);
+            if (mSplice)
+                mSplice->stamp(buf);
+            sendto(buf, size);
+            size = 0;
+        }
+    }
+
+    if (diff >= PCMD_PERIOD_MS) {
+        u32 tsPCMD = (mPCMDSeq++ << 24) | ((mClock ? mClock->getDroneMs() : millis()) & 0x00ffffff);
         u8  buf[40];
 
-        size = Bebop::buildCmd(buf, FRAME_TYPE_DATA, BUFFER_ID_C2D_PCMD, "BBHBbbbbI", PROJECT_ARDRONE3, ARDRONE3_CLASS_PILOTING, 2,
-            flag, 0, 0, 0, 0, tsPCMD);
-        sendto(buf, size);
+        checkFailsafe(ts);
         mLastTS = ts;
+
+        // the app PCMD is mixed on its way through, no extra frame
+        if (isAppActive(ts)) {
+            flush();
+            return 0;
+        }
+
+        if (isFailsafe() || !isRCInControl(ts)) {
+            size = Bebop::buildCmd(buf, FRAME_TYPE_DATA, BUFFER_ID_C2D_PCMD, "BBHBbbbbI", PROJECT_ARDRONE3, ARDRONE3_CLASS_PILOTING, 2,
+                0, 0, 0, 0, 0, tsPCMD);
+            if (mRec)
+                mRec->addPCMD(isFailsafe() ? Recorder::PCMD_FAILSAFE : Recorder::PCMD_RC, 0, 0, 0, 0, 0);
+        } else {
+            size = Bebop::buildCmd(buf, FRAME_TYPE_DATA, BUFFER_ID_C2D_PCMD, "BBHBbbbbI", PROJECT_ARDRONE3, ARDRONE3_CLASS_PILOTING, 2,
+                mEnRollPitch, mRoll, mPitch, mYaw, mGaz, tsPCMD);
+            if (mRec)
+                mRec->addPCMD(Recorder::PCMD_RC, mEnRollPitch, mRoll, mPitch, mYaw, mGaz);
+        }
+        // the app PCMDs go on after ours when it takes over again
+        if (mPCMDSplice)
+            mPCMDSplice->stamp(buf);
+        sendto(buf, size);
+        flush();
     }
     return size;
 }
@@ -18,8 +18,19 @@
 #include "Common.h"
 #include "Bebop.h"
 #include "NavServer.h"
+#include "FrameClassifier.h"
+#include "TxBatcher.h"
+#include "LinkQuality.h"
+#include "VideoThrottle.h"
+#include "ClockSync.h"
+#include "Stats.h"
+#include "StateCache.h"
+#include "Recorder.h"
+#include "Failsafe.h"
+#include "SeqSplice.h"
 
 #define HEADER_LEN  7
+#define BRG_MAX_SUBS    4
 
 // http://robotika.cz/robots/katarina/en#150202
 // https://github.com/robotika/katarina
@@ -29,24 +40,117 @@
 class BridgeServer : public NavServer
 {
 public:
+    enum {
+        FAILSAFE_HOVER = Failsafe::ACTION_HOVER,
+        FAILSAFE_LAND  = Failsafe::ACTION_LAND,
+        FAILSAFE_HOME  = Failsafe::ACTION_HOME,
+    };
+
+    enum {
+        MIX_APP_ONLY = 0,           // app PCMD forwarded untouched
+        MIX_RC_ACTIVE,              // RC overrides while the sticks are off center
+        MIX_RC_FIRST,               // RC overrides while alive, app on RC failsafe
+    };
+
+    enum {
+        SUB_ALL = 0,
+        SUB_NO_VIDEO,               // all but the video stream
+        SUB_TELEMETRY,              // reports and settings only
+    };
+
     BridgeServer(char *name, int port);
     ~BridgeServer();
 
-    void setDest(IPAddress hostIP, int hostport)    { mHostIP = hostIP; mHostPort = hostport; }
+    void setDest(IPAddress hostIP, int hostport);   // the only subscriber
+    int  addSubscriber(IPAddress ip, int port, u8 filter = SUB_ALL, u32 rate = 0);
+    void removeSubscriber(IPAddress ip);
+    void setSubscriberFilter(int idx, u8 id, bool pass);
+    u8   getSubscriberCnt(void)                     { return mSubCnt; }
+    void setDecimator(Decimator *decim, u8 firstSink) { mDecim = decim; mDecimSink = firstSink; }
+    void deliver(u8 sink, u8 *frame, u8 size);     // decimated report for a watching app
+    IPAddress getHostIP(void)                       { return mHostIP; }
+    void setSource(IPAddress ip)                    { mSourceIP = ip; }  // the only app let through, 0 for any
     void setBypass(bool bypass)                     { mBypass = bypass; }
-    void sendto(u8 *data, int size);                // send to host ip/port
+    void sendto(u8 *data, int size);                // queue for the subscribers
+    void flush(void);
+    int  process(u8 *dataAck);
     int  kick(void);
+    void move(u8 enRollPitch, s8 roll, s8 pitch, s8 yaw, s8 gaz);
+    void setFailsafe(bool failsafe)                 { mFailsafe.setRCFailsafe(failsafe); }
+    void setFailsafeAction(u8 action)               { mFailsafe.setAction(action); }
+    bool isFailsafe(void)                           { return mFailsafe.isOn(); }
+    void setMixPolicy(u8 policy)                    { mMixPolicy = policy; }
+    void setTapCallback(void (*callback)(u8 *frame, u32 size))  { mTapCallback = callback; }
+    void setLinkQuality(LinkQuality *link)          { mLink = link; }
+    void setVideoThrottle(VideoThrottle *video)     { mVideo = video; }
+    void setClockSync(ClockSync *clock)             { mClock = clock; }
+    void setStats(Stats *stats, u8 dir)             { mStats = stats; mDir = dir; }
+    void setStateCache(StateCache *cache)           { mCache = cache; }
+    void setRecorder(Recorder *rec)                 { mRec = rec; }
+    void setSeqSplice(SeqSplice *splice)            { mSplice = splice; }
+    void setPCMDSplice(SeqSplice *splice)           { mPCMDSplice = splice; }
     virtual int preProcess(u8 *data, u32 size, u8 *dataAck);
     
 private:
+    typedef struct {
+        u32     ip;
+        int     port;
+        u32     filter[8];      // bit per buffer id, set for pass
+        u32     rate;           // bytes/s, 0 for no limit
+        s32     tokens;
+        u32     ts;
+        u32     frames;
+        u32     drops;
+    } SUB_T;
+
     char *mName;
 
     WiFiUDP mUDPHost;   // TX only
     IPAddress mHostIP;  // TX only
     int     mHostPort;
+    u32     mSourceIP;
+    TxBatcher mTx;
+    SUB_T   mSubs[BRG_MAX_SUBS];
+    u8      mSubCnt;
+    u8      mDecimSink;         // sink of the second subscriber, the pilot is not decimated
     bool    mBypass;
     u8      mPCMDSeq;
     u32     mLastTS;
+
+    u8      mEnRollPitch;
+    s8      mRoll;
+    s8      mPitch;
+    s8      mYaw;
+    s8      mGaz;
+    Failsafe mFailsafe;
+    u8      mMixPolicy;
+    u32     mRCActiveTS;
+    u32     mAppPCMDTS;
+    void    (*mTapCallback)(u8 *frame, u32 size);
+    LinkQuality *mLink;
+    VideoThrottle *mVideo;
+    ClockSync *mClock;
+    Stats   *mStats;
+    StateCache *mCache;
+    Recorder *mRec;
+    SeqSplice *mSplice;
+    SeqSplice *mPCMDSplice;     // the RC PCMDs between app ones
+    u8      mDir;
+
+    void    checkFailsafe(long ts);
+    bool    isAppActive(long ts);
+    bool    isRCInControl(long ts);
+    void    mixPCMD(u8 *data);
+    bool    probeLink(u8 *data, u32 size);
+    bool    throttleVideo(u8 *data, u32 size);
+    void    watchClock(u8 *data, u32 size);
+    virtual void badFrame(void);
+    bool    cacheFrame(u8 *data, u32 size);
+    bool    spliceSeq(SeqSplice *splice);
+    bool    admit(u8 idx, u8 *frame, u16 len, u32 ts);
+    void    sendSub(SUB_T *sub, u8 *frame, u16 size);
+    void    sendApp(u32 ip, u8 *frame, u16 size);
+    bool    isDecimated(u8 *frame, u16 len);
 };
 
 #endif
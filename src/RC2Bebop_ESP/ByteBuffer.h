@@ -119,16 +119,21 @@ public:
         mBufIdx += len;
     }
 
+    // an unterminated string at the end of the buffer reads as empty
     inline char *getstr(void)
     {
         int i;
-        for (i = 0; i < mBufSize; i++) {
-            if (!mBuf[mBufIdx + i])
+        for (i = mBufIdx; i < mBufSize; i++) {
+            if (!mBuf[i])
                 break;
         }
+        if (i >= mBufSize) {
+            mBufIdx = mBufSize;
+            return (char*)"";
+        }
 
         char *ptr = (char*)&mBuf[mBufIdx];
-        mBufIdx += i;
+        mBufIdx = i + 1;
         return ptr;
     }
 
@@ -0,0 +1,366 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+#include "Capture.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include "ClockSync.h"
+#include "Utils.h"
+#define CAP_LOG(...)    Utils::printf(__VA_ARGS__)
+#else
+#include <time.h>
+#define CAP_LOG(...)    fprintf(stderr, __VA_ARGS__)
+#endif
+
+#define VIDEO_BUFFER_ID     125     // BUFFER_ID_D2C_VID
+
+static int put16(u8 *buf, u16 v)
+{
+    buf[0] = v & 0xff;
+    buf[1] = (v >> 8) & 0xff;
+    return 2;
+}
+
+static int put32(u8 *buf, u32 v)
+{
+    buf[0] = v & 0xff;
+    buf[1] = (v >>  8) & 0xff;
+    buf[2] = (v >> 16) & 0xff;
+    buf[3] = (v >> 24) & 0xff;
+    return 4;
+}
+
+// network order for the synthetic headers
+static int put16BE(u8 *buf, u16 v)
+{
+    buf[0] = (v >> 8) & 0xff;
+    buf[1] = v & 0xff;
+    return 2;
+}
+
+static u16 get16(u8 *buf) { return buf[0] | (buf[1] << 8); }
+static u32 get32(u8 *buf) { return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((u32)buf[3] << 24); }
+
+Capture::Capture()
+{
+    mEnable     = true;
+    mPending    = false;
+    mEntryPos   = 0;
+    mSnapLen    = CAP_SNAP_LEN;
+    mOwner      = NULL;
+    mResumeOwner = NULL;
+    mHead       = 0;
+    mTail       = 0;
+    mEntries    = 0;
+    mOverwrites = 0;
+    mClock      = NULL;
+#ifdef ARDUINO
+    mDumping    = false;
+    mDumpPos    = 0;
+    mDumpPort   = 0;
+    mDumpHdr    = 0;
+    mWallOffset = 0;
+#else
+    mFile       = NULL;
+#endif
+}
+
+Capture::~Capture()
+{
+#ifndef ARDUINO
+    commit();
+    if (mFile)
+        fclose(mFile);
+#endif
+}
+
+#ifdef ARDUINO
+bool Capture::begin(const char *path)
+{
+    mUDP.begin(CAP_PORT);
+    Utils::printf("Capture port : %d\n", CAP_PORT);
+    return true;
+}
+
+u64 Capture::now(void)
+{
+    return mClock ? mClock->getLocalUs() : micros();
+}
+
+// the source of what we send is the interface on the destination side
+u32 Capture::getLocalIP(u32 dstIP)
+{
+    u32 ap = WiFi.softAPIP();
+
+    if (((ap ^ dstIP) & 0x00ffffff) == 0)
+        return ap;
+    return WiFi.localIP();
+}
+
+// a dump freezes the ring, one datagram of whole pcap records per call
+void Capture::process(void)
+{
+    u8  buf[CAP_DUMP_LEN];
+    int len = 0;
+
+    if (!mDumping) {
+        if (mUDP.parsePacket() <= 0)
+            return;
+        commit();
+        mDumping    = true;
+        mDumpPos    = mTail;
+        mDumpIP     = mUDP.remoteIP();
+        mDumpPort   = mUDP.remotePort();
+        mDumpHdr    = 1;
+        mWallOffset = mClock ? (s64)mClock->getEpoch() * 1000000 - (s64)now() : 0;
+        CAP_LOG("CAP dump : %d entries, %d bytes\n", mEntries, getUsed());
+    }
+
+    if (mDumpHdr) {
+        len += buildHeader(buf);
+        mDumpHdr = 0;
+    }
+    while (mDumpPos != mHead) {
+        u8  entry[CAP_ENTRY_LEN];
+
+        peek(mDumpPos, entry, CAP_ENTRY_LEN);
+        u16 caplen = get16(&entry[20]);
+        if (len + PCAP_REC_LEN + PCAP_NET_LEN + caplen > CAP_DUMP_LEN)
+            break;
+        len += toPcap(mDumpPos, &buf[len], mWallOffset);
+        mDumpPos = (mDumpPos + CAP_ENTRY_LEN + caplen) & (CAP_BUF_LEN - 1);
+    }
+
+    mUDP.beginPacket(mDumpIP, mDumpPort);
+    mUDP.write(buf, len);
+    mUDP.endPacket();
+
+    if (mDumpPos == mHead)
+        mDumping = false;
+}
+
+#else
+bool Capture::begin(const char *path)
+{
+    u8  hdr[PCAP_HDR_LEN];
+
+    if (!path)
+        path = "bridge.pcap";
+    mFile = fopen(path, "wb");
+    if (!mFile) {
+        CAP_LOG("CAP : can't open %s\n", path);
+        return false;
+    }
+    fwrite(hdr, 1, buildHeader(hdr), mFile);
+    return true;
+}
+
+u64 Capture::now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+u32 Capture::getLocalIP(u32 /* dstIP */)
+{
+    return 0x0100007f;      // 127.0.0.1
+}
+
+void Capture::process(void)
+{
+}
+#endif
+
+int Capture::buildHeader(u8 *buf)
+{
+    int idx = 0;
+
+    idx += put32(&buf[idx], PCAP_MAGIC);
+    idx += put16(&buf[idx], 2);
+    idx += put16(&buf[idx], 4);
+    idx += put32(&buf[idx], 0);
+    idx += put32(&buf[idx], 0);
+    idx += put32(&buf[idx], PCAP_NET_LEN + CAP_SNAP_LEN);
+    idx += put32(&buf[idx], PCAP_LINKTYPE_ETH);
+    return idx;
+}
+
+void Capture::peek(u16 pos, u8 *data, u16 size)
+{
+    for (u16 i = 0; i < size; i++)
+        data[i] = mBuf[(pos + i) & (CAP_BUF_LEN - 1)];
+}
+
+void Capture::poke(u16 pos, u8 *data, u16 size)
+{
+    for (u16 i = 0; i < size; i++)
+        mBuf[(pos + i) & (CAP_BUF_LEN - 1)] = data[i];
+}
+
+// the oldest entries go until size fits
+void Capture::evict(u16 size)
+{
+    while (CAP_BUF_LEN - 1 - getUsed() < size && mTail != mHead) {
+        u8 caplen[2];
+
+        peek(mTail + 20, caplen, 2);
+        mTail = (mTail + CAP_ENTRY_LEN + get16(caplen)) & (CAP_BUF_LEN - 1);
+        mOverwrites++;
+    }
+}
+
+void Capture::open(u32 srcIP, u16 srcPort, u32 dstIP, u16 dstPort, const void *owner)
+{
+    u64 ts;
+
+    commit();
+#ifdef ARDUINO
+    if (!mEnable || mDumping)
+        return;
+#else
+    if (!mEnable || !mFile)
+        return;
+#endif
+
+    evict(CAP_ENTRY_LEN + CAP_SNAP_LEN);
+    ts = now();
+    put32(&mEntry[0],  (u32)ts);
+    put32(&mEntry[4],  (u32)(ts >> 32));
+    put32(&mEntry[8],  srcIP);
+    put32(&mEntry[12], dstIP);
+    put16(&mEntry[16], srcPort);
+    put16(&mEntry[18], dstPort);
+    put16(&mEntry[20], 0);
+    put16(&mEntry[22], 0);
+
+    mEntryPos = mHead;
+    mHead     = (mHead + CAP_ENTRY_LEN) & (CAP_BUF_LEN - 1);
+    mSnapLen  = CAP_SNAP_LEN;
+    mPending  = true;
+    mOwner    = owner;
+    if (owner) {
+        mResumeOwner = owner;
+        memcpy(mResume, &mEntry[8], sizeof(mResume));
+    }
+}
+
+void Capture::append(u8 *data, u16 size, const void *owner)
+{
+    u16 caplen;
+    u16 len;
+    u16 n;
+
+    if (owner && owner == mResumeOwner && (!mPending || mOwner != owner))
+        open(get32(&mResume[0]), get16(&mResume[8]), get32(&mResume[4]), get16(&mResume[10]), owner);
+    if (!mPending)
+        return;
+
+    caplen = get16(&mEntry[20]);
+    len    = get16(&mEntry[22]);
+    if (len == 0 && size >= 2 && data[1] == VIDEO_BUFFER_ID)
+        mSnapLen = CAP_VIDEO_SNAP_LEN;
+
+    n = (caplen + size > mSnapLen) ? mSnapLen - caplen : size;
+    poke(mHead, data, n);
+    mHead = (mHead + n) & (CAP_BUF_LEN - 1);
+    put16(&mEntry[20], caplen + n);
+    put16(&mEntry[22], len + size);
+}
+
+void Capture::commit(void)
+{
+    if (!mPending)
+        return;
+
+    poke(mEntryPos, mEntry, CAP_ENTRY_LEN);
+    mPending = false;
+    mEntries++;
+
+#ifndef ARDUINO
+    u8  buf[PCAP_REC_LEN + PCAP_NET_LEN + CAP_SNAP_LEN];
+
+    fwrite(buf, 1, toPcap(mEntryPos, buf, 0), mFile);
+    mTail = mHead;
+#endif
+}
+
+void Capture::add(u32 srcIP, u16 srcPort, u32 dstIP, u16 dstPort, u8 *data, u16 size)
+{
+    open(srcIP, srcPort, dstIP, dstPort);
+    append(data, size);
+    commit();
+}
+
+// pcap record, ethernet / ipv4 / udp and the captured payload
+int Capture::toPcap(u16 pos, u8 *buf, s64 wallOffset)
+{
+    u8  entry[CAP_ENTRY_LEN];
+    u64 ts;
+    u16 caplen;
+    u16 len;
+    u32 sum = 0;
+    int idx = 0;
+
+    peek(pos, entry, CAP_ENTRY_LEN);
+    ts     = (get32(&entry[0]) | ((u64)get32(&entry[4]) << 32)) + wallOffset;
+    caplen = get16(&entry[20]);
+    len    = get16(&entry[22]);
+
+    idx += put32(&buf[idx], (u32)(ts / 1000000));
+    idx += put32(&buf[idx], (u32)(ts % 1000000));
+    idx += put32(&buf[idx], PCAP_NET_LEN + caplen);
+    idx += put32(&buf[idx], PCAP_NET_LEN + len);
+
+    // locally administered macs ending with the last ip byte
+    u8 *eth = &buf[idx];
+    memset(eth, 0, 12);
+    eth[0] = 0x02;
+    eth[5] = entry[15];
+    eth[6] = 0x02;
+    eth[11] = entry[11];
+    idx += 12;
+    idx += put16BE(&buf[idx], 0x0800);
+
+    u8 *ip = &buf[idx];
+    ip[0] = 0x45;
+    ip[1] = 0;
+    put16BE(&ip[2], 20 + 8 + len);
+    put16BE(&ip[4], 0);
+    put16BE(&ip[6], 0x4000);        // don't fragment
+    ip[8] = 64;
+    ip[9] = 17;
+    put16BE(&ip[10], 0);
+    memcpy(&ip[12], &entry[8], 4);
+    memcpy(&ip[16], &entry[12], 4);
+    for (u8 i = 0; i < 20; i += 2)
+        sum += (ip[i] << 8) | ip[i + 1];
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    put16BE(&ip[10], ~sum);
+    idx += 20;
+
+    idx += put16BE(&buf[idx], get16(&entry[16]));
+    idx += put16BE(&buf[idx], get16(&entry[18]));
+    idx += put16BE(&buf[idx], 8 + len);
+    idx += put16BE(&buf[idx], 0);   // no checksum
+
+    peek(pos + CAP_ENTRY_LEN, &buf[idx], caplen);
+    idx += caplen;
+
+    return idx;
+}
@@ -0,0 +1,107 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include "common.h"
+
+#ifdef ARDUINO
+#include <WiFiUdp.h>
+#else
+#include <stdio.h>
+#endif
+
+#define CAP_PORT            55001
+#define CAP_BUF_LEN         8192    // power of 2
+#define CAP_SNAP_LEN        128     // ARNetwork headers and the commands, not the whole video
+#define CAP_VIDEO_SNAP_LEN  16      // frame header and fragment header
+#define CAP_DUMP_LEN        1400    // pcap bytes per dump datagram
+#define CAP_ENTRY_LEN       24      // ts us(8), src ip(4), dst ip(4), sport(2), dport(2), caplen(2), len(2)
+
+// pcap, ethernet link type with synthetic ethernet / ipv4 / udp headers so the
+// captures open the same way as the ones taken in monitor mode
+#define PCAP_MAGIC          0xa1b2c3d4
+#define PCAP_HDR_LEN        24
+#define PCAP_REC_LEN        16
+#define PCAP_NET_LEN        42      // ethernet 14, ipv4 20, udp 8
+#define PCAP_LINKTYPE_ETH   1
+
+class ClockSync;
+
+// datagram tap for the bridges.
+// entries go to a ram ring that overwrites the oldest, one entry costs a copy of
+// CAP_SNAP_LEN bytes at most. the ring is turned into pcap only when it is dumped.
+// a datagram to CAP_PORT starts a dump to the sender, one datagram per process() :
+//   echo -n d | nc -u -w 2 <esp ip> 55001 > esp.pcap
+class Capture
+{
+public:
+    Capture();
+    ~Capture();
+
+    bool begin(const char *path = NULL);    // host build : pcap file
+    void setClockSync(ClockSync *clock)     { mClock = clock; }
+    void setEnable(bool enable)             { mEnable = enable; }
+
+    // one datagram, the payload can come in several pieces.
+    // with an owner, its pieces go on in a new entry when someone else opened one in between
+    void open(u32 srcIP, u16 srcPort, u32 dstIP, u16 dstPort, const void *owner = NULL);
+    void append(u8 *data, u16 size, const void *owner = NULL);
+    void commit(void);
+    void add(u32 srcIP, u16 srcPort, u32 dstIP, u16 dstPort, u8 *data, u16 size);
+    void process(void);
+
+    static u32 getLocalIP(u32 dstIP);
+    u32  getEntries(void)                   { return mEntries; }
+    u32  getOverwrites(void)                { return mOverwrites; }
+
+private:
+    bool    mEnable;
+    bool    mPending;
+    u8      mEntry[CAP_ENTRY_LEN];      // header of the pending entry
+    u16     mEntryPos;                  // ring position of the pending entry
+    u16     mSnapLen;
+    const void *mOwner;
+    const void *mResumeOwner;
+    u8      mResume[12];                // ips and ports of the owner entry
+
+    u8      mBuf[CAP_BUF_LEN];
+    u16     mHead;
+    u16     mTail;
+    u32     mEntries;
+    u32     mOverwrites;
+    ClockSync *mClock;
+
+#ifdef ARDUINO
+    WiFiUDP mUDP;
+    bool    mDumping;
+    u16     mDumpPos;
+    IPAddress mDumpIP;
+    u16     mDumpPort;
+    u32     mDumpHdr;                   // pcap header to send first
+    s64     mWallOffset;                // us, wall - local at the start of the dump
+#else
+    FILE    *mFile;
+#endif
+
+    u16  getUsed(void)                  { return (mHead - mTail) & (CAP_BUF_LEN - 1); }
+    void evict(u16 size);
+    void peek(u16 pos, u8 *data, u16 size);
+    void poke(u16 pos, u8 *data, u16 size);
+    int  toPcap(u16 pos, u8 *buf, s64 wallOffset);
+    u64  now(void);
+    static int buildHeader(u8 *buf);
+};
+
+#endif
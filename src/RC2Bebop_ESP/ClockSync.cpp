@@ -0,0 +1,148 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include "ClockSync.h"
+#include "Utils.h"
+
+static const char *TBL_MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+ClockSync::ClockSync()
+{
+    char mon[4];
+    int  y, d, hh, mm, ss;
+    u8   m = 1;
+
+    mLastUs  = 0;
+    mWrapUs  = 0;
+    mOffset  = 0;
+    mSamples = 0;
+
+    // build time until somebody tells us better, "Apr 20 2016" "15:28:03"
+    sscanf(__DATE__, "%3s %d %d", mon, &d, &y);
+    sscanf(__TIME__, "%d:%d:%d", &hh, &mm, &ss);
+    const char *p = strstr(TBL_MONTHS, mon);
+    if (p)
+        m = (p - TBL_MONTHS) / 3 + 1;
+
+    mWallDays    = daysFromCivil(y, m, d);
+    mWallSecs    = hh * 3600L + mm * 60 + ss;
+    mWallUs      = 0;
+    mWallSrcDate = WALL_BUILD;
+    mWallSrcTime = WALL_BUILD;
+}
+
+u64 ClockSync::getLocalUs(void)
+{
+    u32 us = micros();
+
+    if (us < mLastUs)
+        mWrapUs++;
+    mLastUs = us;
+
+    return ((u64)mWrapUs << 32) | us;
+}
+
+// the drone stamps its pings with its clock, it is rtt/2 old when it gets here
+void ClockSync::onDronePing(u8 *data, u32 size, u32 rtt)
+{
+    if (size < 8 || rtt == 0 || rtt > CLOCK_MAX_RTT_US)
+        return;
+
+    u64 drone = (u64)Utils::get32(&data[0]) * 1000000 + Utils::get32(&data[4]) / 1000 + rtt / 2;
+    s64 offset = (s64)(drone - getLocalUs());
+
+    if (mSamples == 0) {
+        mOffset = offset;
+    } else {
+        mOffset += (offset - mOffset) / 8;
+    }
+    mSamples++;
+}
+
+// Howard Hinnant's civil calendar algorithms
+s32 ClockSync::daysFromCivil(s32 y, u8 m, u8 d)
+{
+    y -= (m <= 2);
+    s32 era = (y >= 0 ? y : y - 399) / 400;
+    u32 yoe = (u32)(y - era * 400);
+    u32 doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    u32 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + (s32)doe - 719468;
+}
+
+void ClockSync::civilFromDays(s32 days, s32 *y, u8 *m, u8 *d)
+{
+    days += 719468;
+    s32 era = (days >= 0 ? days : days - 146096) / 146097;
+    u32 doe = (u32)(days - era * 146097);
+    u32 yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    u32 doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    u32 mp  = (5 * doy + 2) / 153;
+
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = (s32)yoe + era * 400 + (*m <= 2);
+}
+
+// a weaker source never overrides a stronger one
+void ClockSync::setDate(char *date, u8 src)
+{
+    int y, m, d;
+
+    if (src < mWallSrcDate || sscanf(date, "%d-%d-%d", &y, &m, &d) != 3)
+        return;
+
+    u32 epoch = getEpoch();
+    mWallSecs    = epoch % 86400;
+    mWallDays    = daysFromCivil(y, m, d);
+    mWallUs      = getLocalUs();
+    mWallSrcDate = src;
+}
+
+void ClockSync::setTime(char *time, u8 src)
+{
+    int hh, mm, ss;
+
+    if (src < mWallSrcTime || sscanf(time, "T%2d%2d%2d", &hh, &mm, &ss) != 3)
+        return;
+
+    mWallDays    = getEpoch() / 86400;
+    mWallSecs    = hh * 3600L + mm * 60 + ss;
+    mWallUs      = getLocalUs();
+    mWallSrcTime = src;
+}
+
+u32 ClockSync::getEpoch(void)
+{
+    return mWallDays * 86400UL + mWallSecs + (u32)((getLocalUs() - mWallUs) / 1000000);
+}
+
+void ClockSync::getDate(char *buf)
+{
+    s32 y;
+    u8  m, d;
+
+    civilFromDays(getEpoch() / 86400, &y, &m, &d);
+    sprintf(buf, "%04d-%02d-%02d", (int)y, m, d);
+}
+
+void ClockSync::getTime(char *buf)
+{
+    u32 secs = getEpoch() % 86400;
+
+    sprintf(buf, "T%02d%02d%02d+0000", (int)(secs / 3600), (int)((secs / 60) % 60), (int)(secs % 60));
+}
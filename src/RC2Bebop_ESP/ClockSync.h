@@ -0,0 +1,63 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _CLOCK_SYNC_H_
+#define _CLOCK_SYNC_H_
+
+#include "Common.h"
+
+#define CLOCK_MAX_RTT_US    50000   // samples behind a slower round trip are not trusted
+
+// drone clock from the drone pings, wall clock from the app or the drone settings
+class ClockSync
+{
+public:
+    enum {
+        WALL_BUILD = 0,         // __DATE__ __TIME__ of this firmware
+        WALL_DRONE,             // COMMONSTATE date / time report
+        WALL_APP,               // COMMON date / time sent by the app
+    };
+
+    ClockSync();
+
+    u64  getLocalUs(void);
+    void onDronePing(u8 *data, u32 size, u32 rtt);
+    bool isSynced(void)                 { return mSamples > 0; }
+    u64  getDroneUs(void)               { return getLocalUs() + mOffset; }
+    u32  getDroneMs(void)               { return (u32)(getDroneUs() / 1000); }
+    s64  getOffset(void)                { return mOffset; }
+
+    void setDate(char *date, u8 src);   // "2016-04-20"
+    void setTime(char *time, u8 src);   // "T152803+0000"
+    u32  getEpoch(void);
+    bool isFromApp(void)                { return mWallSrcDate == WALL_APP && mWallSrcTime == WALL_APP; }
+    void getDate(char *buf);
+    void getTime(char *buf);
+
+private:
+    u32     mLastUs;
+    u32     mWrapUs;            // micros() overflow count
+    s64     mOffset;            // drone - local, us
+    u32     mSamples;
+
+    s32     mWallDays;          // days since 1970-01-01
+    s32     mWallSecs;          // seconds of the day
+    u64     mWallUs;            // local time of the last wall clock update
+    u8      mWallSrcDate;
+    u8      mWallSrcTime;
+
+    static s32 daysFromCivil(s32 y, u8 m, u8 d);
+    static void civilFromDays(s32 days, s32 *y, u8 *m, u8 *d);
+};
+
+#endif
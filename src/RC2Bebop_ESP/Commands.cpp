@@ -18,11 +18,16 @@
 #include "Utils.h"
 #include "ByteBuffer.h"
 
-Commands::Commands()
+#define CFG_STEPS   7
+
+Commands::Commands() : mTx(&mUDP)
 {
     mPort    = 0;
-    mCfgIdx  = 0;
     mPCMDSeq = 0;
+    resetConfig();
+    mClock   = NULL;
+    mSplice  = NULL;
+    mPCMDSplice = NULL;
 }
 
 Commands::~Commands()
@@ -34,11 +39,10 @@ void Commands::sendto(u8 *data, int size)
 {
     if (mDestIP[0] == 0 || mPort == 0) {
         Utils::printf("NO DEST IP or Port\n");
-}
+        return;
+    }
 
-    mUDP.beginPacket(mDestIP, mPort);
-    mUDP.write(data, size);
-    mUDP.endPacket();
+    mTx.add(data, size);
 
     //Utils::dump(data, size);
     //Serial.printf("-------------------------TX END -----------------------\n\n");
@@ -81,14 +85,22 @@ void Commands::recordVideo(u8 enable, u8 storage)
 void Commands::setDate(void)
 {
     PRINT_FUNC;
-    int size = Bebop::buildCmd(mBuf, FRAME_TYPE_DATA, BUFFER_ID_C2D_SETTINGS, "BBHS", PROJECT_COMMON, COMMON_CLASS_COMMON, 1, "2016-04-20");
+    char str[20] = "2016-04-20";
+
+    if (mClock)
+        mClock->getDate(str);
+    int size = Bebop::buildCmd(mBuf, FRAME_TYPE_DATA, BUFFER_ID_C2D_SETTINGS, "BBHS", PROJECT_COMMON, COMMON_CLASS_COMMON, 1, str);
     sendto(mBuf, size);
 }
 
 void Commands::setTime(void)
 {
     PRINT_FUNC;
-    int size = Bebop::buildCmd(mBuf, FRAME_TYPE_DATA, BUFFER_ID_C2D_SETTINGS, "BBHS", PROJECT_COMMON, COMMON_CLASS_COMMON, 2, "T152803+0000");
+    char str[20] = "T152803+0000";
+
+    if (mClock)
+        mClock->getTime(str);
+    int size = Bebop::buildCmd(mBuf, FRAME_TYPE_DATA, BUFFER_ID_C2D_SETTINGS, "BBHS", PROJECT_COMMON, COMMON_CLASS_COMMON, 2, str);
     sendto(mBuf, size);
 }
 
@@ -155,29 +167,147 @@ void Commands::resetHome(void)
     sendto(mBuf, size);
 }
 
+void Commands::resetConfig(void)
+{
+    mCfgIdx     = 0;
+    mCfgDone    = 0;
+    mCfgStartTS = 0;
+    mCfgTime    = 0;
+    memset(mCfgSlots, 0, sizeof(mCfgSlots));
+}
+
+// config steps, settings go out ack required so the pipeline can advance on the ack
+int Commands::buildStep(u8 step, u8 *buf, bool *ack)
+{
+    char str[20];
+
+    *ack = true;
+
+    // a clock not learned from the app is worse than the one of the drone
+    if (step <= 1 && mClock && !mClock->isFromApp()) {
+        *ack = false;
+        return 0;
+    }
+
+    switch (step) {
+        case 0:
+            strcpy(str, "2016-04-20");
+            if (mClock)
+                mClock->getDate(str);
+            return Bebop::buildCmd(buf, FRAME_TYPE_DATA_WITH_ACK, BUFFER_ID_C2D_SETTINGS, "BBHS", PROJECT_COMMON, COMMON_CLASS_COMMON, 1, str);
+
+        case 1:
+            strcpy(str, "T152803+0000");
+            if (mClock)
+                mClock->getTime(str);
+            return Bebop::buildCmd(buf, FRAME_TYPE_DATA_WITH_ACK, BUFFER_ID_C2D_SETTINGS, "BBHS", PROJECT_COMMON, COMMON_CLASS_COMMON, 2, str);
+
+        case 2:
+            return Bebop::buildCmd(buf, FRAME_TYPE_DATA_WITH_ACK, BUFFER_ID_C2D_SETTINGS, "BBH", PROJECT_COMMON, COMMON_CLASS_COMMON, 0);
+
+        case 3:
+            return Bebop::buildCmd(buf, FRAME_TYPE_DATA_WITH_ACK, BUFFER_ID_C2D_SETTINGS, "BBH", PROJECT_COMMON, COMMON_CLASS_SETTINGS, 0);
+
+        case 4:
+            *ack = false;
+            return Bebop::buildCmd(buf, FRAME_TYPE_DATA, BUFFER_ID_C2D_PCMD, "BBHBB", PROJECT_ARDRONE3, ARDRONE3_CLASS_CAMERA, 0, 0, 0);
+
+        case 5:
+            return Bebop::buildCmd(buf, FRAME_TYPE_DATA_WITH_ACK, BUFFER_ID_C2D_SETTINGS, "BBHBB", PROJECT_ARDRONE3, ARDRONE3_CLASS_PICTURESETTINGS, 5, 1, 0);
+
+        case 6:
+            return Bebop::buildCmd(buf, FRAME_TYPE_DATA_WITH_ACK, BUFFER_ID_C2D_SETTINGS, "BBHB", PROJECT_ARDRONE3, ARDRONE3_CLASS_MEDIASTREAMING, 0, 0);
+    }
+
+    *ack = false;
+    return 0;
+}
+
+// a retry is built again with a new seq id, the drone drops a retransmit that
+// arrives after a newer frame of the same buffer. the app may be on the buffer
+// already, the splice puts us in its seq space
+void Commands::issueStep(CFG_SLOT_T *slot, u8 step)
+{
+    bool ack;
+    int  size = buildStep(step, mBuf, &ack);
+
+    if (size > 0) {
+        if (mSplice && mBuf[1] == mSplice->getID())
+            mSplice->stamp(mBuf);
+        else if (mPCMDSplice && mBuf[1] == mPCMDSplice->getID())
+            mPCMDSplice->stamp(mBuf);
+        sendto(mBuf, size);
+    }
+    if (!ack) {
+        slot->busy = 0;
+        mCfgDone++;
+        return;
+    }
+    slot->step = step;
+    slot->seq  = mBuf[2];
+    slot->busy = 1;
+    slot->ts   = millis();
+}
+
+void Commands::onAck(u8 id, u8 seq)
+{
+    if (id != BUFFER_ID_C2D_SETTINGS)
+        return;
+
+    for (u8 i = 0; i < CFG_WINDOW; i++) {
+        CFG_SLOT_T *slot = &mCfgSlots[i];
+
+        if (slot->busy && slot->seq == seq) {
+            slot->busy = 0;
+            mCfgDone++;
+        }
+    }
+}
+
+// keeps up to CFG_WINDOW steps in flight, true once every step is acked or given up
 bool Commands::config(void)
 {
-    bool done = false;
-    long ts   = millis();
-    int  diff = ts - mLastTS;
+    u32 ts = millis();
+
+    if (mCfgTime > 0)
+        return true;
+    if (mCfgStartTS == 0)
+        mCfgStartTS = ts ? ts : 1;
+
+    for (u8 i = 0; i < CFG_WINDOW; i++) {
+        CFG_SLOT_T *slot = &mCfgSlots[i];
+
+        if (slot->busy && ts - slot->ts >= CFG_RETRY_MS) {
+            if (++slot->tries >= CFG_MAX_TRIES) {
+                Utils::printf("CONFIG step %d not acked, skipped\n", slot->step);
+                slot->busy = 0;
+                mCfgDone++;
+            } else {
+                u8 tries = slot->tries;
+
+                issueStep(slot, slot->step);
+                slot->tries = tries;
+            }
+        }
 
-    if (diff >= 50) {
-        switch (mCfgIdx) {
-            case 0: setDate();          break;
-            case 1: setTime();          break;
-            case 2: requestStates();    break;
-            case 3: requestSettings();  break;
-            case 4: moveCamera(0, 0);   break;
-            case 5: enableVideoAutoRecording(1);    break;
-            case 6: enableVideoStreaming(0);
-                done = true;
-                break;
+        if (!slot->busy && mCfgIdx < CFG_STEPS) {
+            slot->tries = 0;
+            issueStep(slot, mCfgIdx++);
         }
-        mCfgIdx++;
-        mLastTS = ts;
     }
+    mTx.flush();
 
-    return done;
+    if (mCfgDone >= CFG_STEPS) {
+        mCfgTime = max(ts - mCfgStartTS, (u32)1);
+        Utils::printf("CONFIG ready in %d ms\n", mCfgTime);
+        return true;
+    }
+    return false;
+}
+
+bool Commands::isConfigDone(void)
+{
+    return mCfgDone >= CFG_STEPS;
 }
 
 void Commands::process(u8 *dataAck, int size)
@@ -192,7 +322,7 @@ void Commands::process(u8 *dataAck, int size)
     // send PCMD every 25ms
     if (diff >= 25) {
         u8  flag = 0;
-        u32 tsPCMD = (mPCMDSeq++ << 24) | (millis() & 0x00ffffff);
+        u32 tsPCMD = (mPCMDSeq++ << 24) | ((mClock ? mClock->getDroneMs() : millis()) & 0x00ffffff);
 
         if (mEnRollPitch)
             flag = 1;
@@ -204,5 +334,8 @@ void Commands::process(u8 *dataAck, int size)
 
         mLastTS = ts;
     }
+
+    // acks, commands queued since the last call and PCMD share one datagram
+    mTx.flush();
 }
 
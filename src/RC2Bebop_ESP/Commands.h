@@ -17,6 +17,9 @@
 #include <WiFiUdp.h>
 #include "Common.h"
 #include "Bebop.h"
+#include "TxBatcher.h"
+#include "ClockSync.h"
+#include "SeqSplice.h"
 
 
 // http://robotika.cz/robots/katarina/en#150202
@@ -27,14 +30,23 @@
 //    0          1       2      3 4 5 6       7
 // frametype, frameid, seqid, payloadlen+7    payload
 
+#define CFG_WINDOW          3       // ack required commands in flight
+#define CFG_RETRY_MS        150
+#define CFG_MAX_TRIES       5
+
 class Commands
 {
 public:
     Commands();
     ~Commands();
 
-    void setDest(IPAddress destIP, int destport)    { mDestIP = destIP; mPort = destport; }
+    void setDest(IPAddress destIP, int destport)    { mDestIP = destIP; mPort = destport; mTx.setDest(destIP, destport); }
     void sendto(u8 *data, int size);
+    void flush(void)                                { mTx.flush(); }
+    void setClockSync(ClockSync *clock)             { mClock = clock; }
+    void setCapture(Capture *cap)                   { mTx.setCapture(cap); }
+    void setSeqSplice(SeqSplice *splice)            { mSplice = splice; }
+    void setPCMDSplice(SeqSplice *splice)           { mPCMDSplice = splice; }
 
     void takeOff(void);
     void land(void);
@@ -53,6 +65,10 @@ public:
     void enableVideoStreaming(u8 enable);
     void moveCamera(s8 tilt, s8 pan);
     bool config(void);
+    void resetConfig(void);
+    void onAck(u8 id, u8 seq);
+    u32  getConfigTime(void)                        { return mCfgTime; }
+    bool isConfigDone(void);
     void process(u8 *dataAck, int size);
 
     s8   getRoll(void)  { return mRoll;     }
@@ -63,6 +79,10 @@ public:
 private:
     u8      mBuf[512];
     WiFiUDP mUDP;
+    TxBatcher mTx;
+    ClockSync *mClock;
+    SeqSplice *mSplice;
+    SeqSplice *mPCMDSplice;
     Bebop   mBebop;
 
     IPAddress mDestIP;
@@ -76,7 +96,22 @@ private:
     s8   mYaw;
     s8   mGaz;
 
-    u8   mCfgIdx;
+    typedef struct {
+        u8  step;
+        u8  seq;
+        u8  tries;
+        u8  busy;
+        u32 ts;
+    } CFG_SLOT_T;
+
+    u8   mCfgIdx;           // next step to issue
+    u8   mCfgDone;          // steps finished
+    CFG_SLOT_T mCfgSlots[CFG_WINDOW];
+    u32  mCfgStartTS;
+    u32  mCfgTime;
+
+    int  buildStep(u8 step, u8 *buf, bool *ack);
+    void issueStep(CFG_SLOT_T *slot, u8 step);
 
     u8   mPCMDSeq;
 };
@@ -0,0 +1,106 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <string.h>
+#include "Decimator.h"
+
+Decimator::Decimator()
+{
+    memset(mKeys, 0, sizeof(mKeys));
+    memset(mSinks, 0, sizeof(mSinks));
+    mKeyCnt = 0;
+}
+
+int Decimator::findKey(u32 cmdID)
+{
+    for (u8 i = 0; i < mKeyCnt; i++) {
+        if (mKeys[i].cmdID == cmdID)
+            return i;
+    }
+    return -1;
+}
+
+// periodMs : floor for every sink, 0 for the sink rates only
+bool Decimator::addKey(u32 cmdID, u16 periodMs)
+{
+    int idx = findKey(cmdID);
+
+    if (idx < 0) {
+        if (mKeyCnt >= DEC_MAX_KEYS)
+            return false;
+        idx = mKeyCnt++;
+    }
+    mKeys[idx].cmdID    = cmdID;
+    mKeys[idx].periodMs = periodMs;
+
+    return true;
+}
+
+void Decimator::setSinkRate(u8 sink, u16 hz)
+{
+    if (sink < DEC_MAX_SINKS)
+        mSinks[sink].periodMs = hz ? max(1000 / hz, 1) : 0;
+}
+
+void Decimator::setCallback(u8 sink, void (*callback)(u8 sink, u32 cmdID, u8 *frame, u8 size))
+{
+    if (sink < DEC_MAX_SINKS)
+        mSinks[sink].callback = callback;
+}
+
+bool Decimator::put(u32 cmdID, u8 *frame, u32 size)
+{
+    int idx = findKey(cmdID);
+
+    if (idx < 0 || size > DEC_FRAME_LEN)
+        return false;
+
+    KEY_T *key = &mKeys[idx];
+
+    // the pending sample is replaced, the sinks that did not take it lose it
+    for (u8 i = 0; i < DEC_MAX_SINKS; i++) {
+        if (mSinks[i].periodMs && mSinks[i].version[idx] != key->version)
+            mSinks[i].drops++;
+    }
+    memcpy(key->frame, frame, size);
+    key->size = size;
+    key->ts   = millis();
+    key->version++;
+
+    return true;
+}
+
+void Decimator::poll(void)
+{
+    u32 ts = millis();
+
+    for (u8 i = 0; i < DEC_MAX_SINKS; i++) {
+        SINK_T *sink = &mSinks[i];
+
+        if (!sink->periodMs || !sink->callback)
+            continue;
+
+        for (u8 j = 0; j < mKeyCnt; j++) {
+            KEY_T *key = &mKeys[j];
+            u16   period = max(sink->periodMs, key->periodMs);
+
+            if (sink->version[j] == key->version || ts - sink->ts[j] < period)
+                continue;
+
+            sink->version[j] = key->version;
+            sink->ts[j]      = ts;
+            (*sink->callback)(i, key->cmdID, key->frame, key->size);
+        }
+    }
+}
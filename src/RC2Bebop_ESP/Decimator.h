@@ -0,0 +1,64 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _DECIMATOR_H_
+#define _DECIMATOR_H_
+
+#include "Common.h"
+
+#define DEC_MAX_KEYS    8
+#define DEC_MAX_SINKS   6
+#define DEC_FRAME_LEN   48      // header + PilotingState position (3 doubles)
+
+// keep-latest decimation of the periodic reports.
+// one slot per command id holds the newest frame, a new sample overwrites the pending one.
+// each sink takes a slot at most at its own rate, so a slow sink only skips samples.
+class Decimator
+{
+public:
+    Decimator();
+
+    bool addKey(u32 cmdID, u16 periodMs);
+    void setSinkRate(u8 sink, u16 hz);          // 0 : sink off
+    void setCallback(u8 sink, void (*callback)(u8 sink, u32 cmdID, u8 *frame, u8 size));
+    bool isKey(u32 cmdID)                       { return findKey(cmdID) >= 0; }
+    bool put(u32 cmdID, u8 *frame, u32 size);   // false when not decimated, the caller goes on as usual
+    void poll(void);
+    u32  getDrops(u8 sink)                      { return mSinks[sink].drops; }
+
+private:
+    typedef struct {
+        u32 cmdID;
+        u16 periodMs;
+        u16 version;            // bumped on each sample
+        u32 ts;
+        u8  size;
+        u8  frame[DEC_FRAME_LEN];
+    } KEY_T;
+
+    typedef struct {
+        u16 periodMs;
+        u16 version[DEC_MAX_KEYS];  // last one handed to the sink
+        u32 ts[DEC_MAX_KEYS];
+        u32 drops;                  // samples overwritten before the sink took them
+        void (*callback)(u8 sink, u32 cmdID, u8 *frame, u8 size);
+    } SINK_T;
+
+    KEY_T   mKeys[DEC_MAX_KEYS];
+    u8      mKeyCnt;
+    SINK_T  mSinks[DEC_MAX_SINKS];
+
+    int  findKey(u32 cmdID);
+};
+
+#endif
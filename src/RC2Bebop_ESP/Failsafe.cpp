@@ -0,0 +1,64 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include "Failsafe.h"
+
+Failsafe::Failsafe()
+{
+    mAction = ACTION_HOVER;
+    reset();
+}
+
+void Failsafe::reset(void)
+{
+    mRCTS       = 0;
+    mRCArmed    = false;
+    mRCFailsafe = false;
+    mTicks      = 0;
+}
+
+// the command to send on this tick, it goes out on the tick the loss is detected
+u8 Failsafe::tick(u32 ts, bool appPilot)
+{
+    u8   send = SEND_NONE;
+    bool lost = mRCFailsafe || (ts - mRCTS >= RC_TIMEOUT_MS);
+
+    if (!lost) {
+        if (mTicks > 0 && mAction == ACTION_HOME)
+            send = SEND_HOME_CANCEL;
+        mRCArmed = true;
+        mTicks   = 0;
+        return send;
+    }
+
+    // nothing to protect until the RC has been seen alive once
+    if (!mRCArmed)
+        return SEND_NONE;
+
+    // the app is the pilot, or the fallback one while it still sends PCMD
+    if (appPilot) {
+        mTicks = 0;
+        return SEND_NONE;
+    }
+
+    if ((mTicks % FAILSAFE_REPEAT_TICKS) == 0) {
+        if (mAction == ACTION_LAND)
+            send = SEND_LAND;
+        else if (mAction == ACTION_HOME)
+            send = SEND_HOME;
+    }
+    if (mTicks < 0xffff)
+        mTicks++;
+
+    return send;
+}
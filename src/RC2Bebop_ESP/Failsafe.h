@@ -0,0 +1,60 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _FAILSAFE_H_
+#define _FAILSAFE_H_
+
+#include "common.h"
+
+#define RC_TIMEOUT_MS           150     // no CMD_SET_RC from the AVR
+#define FAILSAFE_REPEAT_TICKS   8       // land / home are not acked, resend every 200ms
+
+// RC loss detection, ticked once per PCMD period. no platform calls so the
+// timing can be checked on the host (tools/rbfailsafe.cpp)
+class Failsafe
+{
+public:
+    enum {
+        ACTION_HOVER = 0,           // zero sticks, roll/pitch flag off
+        ACTION_LAND,
+        ACTION_HOME,
+    };
+
+    enum {
+        SEND_NONE = 0,
+        SEND_LAND,
+        SEND_HOME,
+        SEND_HOME_CANCEL,
+    };
+
+    Failsafe();
+
+    void reset(void);
+    void setAction(u8 action)       { mAction = action;       }
+    u8   getAction(void)            { return mAction;         }
+    void setRCFailsafe(bool lost)   { mRCFailsafe = lost;     }
+    void onRC(u32 ts)               { mRCTS = ts;             }
+    bool isOn(void)                 { return mTicks > 0;      }
+    u16  getTicks(void)             { return mTicks;          }
+    bool isRCAlive(u32 ts)          { return mRCArmed && !mRCFailsafe && (ts - mRCTS < RC_TIMEOUT_MS); }
+    u8   tick(u32 ts, bool appPilot);
+
+private:
+    u32     mRCTS;
+    bool    mRCArmed;
+    bool    mRCFailsafe;
+    u8      mAction;
+    u16     mTicks;
+};
+
+#endif
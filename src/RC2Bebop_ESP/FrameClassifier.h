@@ -0,0 +1,59 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _FRAME_CLASSIFIER_H_
+#define _FRAME_CLASSIFIER_H_
+
+#include "Common.h"
+#include "Utils.h"
+#include "Bebop.h"
+#include "NavServer.h"
+
+// header (7) + prj, cls, cmd(2)
+#define CLASSIFY_LEN    11
+
+// decides what the bridge does with a frame by looking at the header and the command id only
+class FrameClassifier
+{
+public:
+    enum {
+        ACT_FWD = 0,        // forward as it is
+        ACT_REWRITE,        // patch in place, then forward
+        ACT_TAP,            // forward and hand a copy of the pointer to the tap
+        ACT_DROP,           // malformed, not forwarded
+    };
+
+    static inline u8 classify(u8 *frame, u32 maxLen, bool tap)
+    {
+        u8  type = frame[0];
+        u8  id   = frame[1];
+        u32 len  = Utils::get32(&frame[3]);
+
+        if (type < FRAME_TYPE_ACK || type > FRAME_TYPE_DATA_WITH_ACK || len < HEADER_LEN || len > maxLen)
+            return ACT_DROP;
+
+        if (type == FRAME_TYPE_ACK || type == FRAME_TYPE_DATA_LOW_LATENCY || len < CLASSIFY_LEN)
+            return ACT_FWD;
+
+        if (id == BUFFER_ID_C2D_PCMD && type == FRAME_TYPE_DATA && frame[7] == PROJECT_ARDRONE3 &&
+            frame[8] == ARDRONE3_CLASS_PILOTING && Utils::get16(&frame[9]) == 2)
+            return ACT_REWRITE;
+
+        if (!tap || id == BUFFER_ID_PING || id == BUFFER_ID_PONG || id == BUFFER_ID_C2D_PCMD)
+            return ACT_FWD;
+
+        return ACT_TAP;
+    }
+};
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+#include "JsonStream.h"
+
+static bool isSpace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+JsonStream::JsonStream()
+{
+    mCallback = NULL;
+    reset();
+}
+
+void JsonStream::reset(void)
+{
+    mState     = ST_START;
+    mEscape    = 0;
+    mDepth     = 0;
+    mNestedStr = 0;
+    mKeyLen    = 0;
+    mValueLen  = 0;
+    mKey[0]    = 0;
+    mValue[0]  = 0;
+}
+
+void JsonStream::addChar(char *buf, u8 *len, u8 size, char ch)
+{
+    if (*len < size - 1) {
+        buf[(*len)++] = ch;
+        buf[*len] = 0;
+    }
+}
+
+void JsonStream::emit(u8 type)
+{
+    if (mCallback)
+        (*mCallback)(mKey, mValue, type);
+    mKeyLen   = 0;
+    mValueLen = 0;
+    mKey[0]   = 0;
+    mValue[0] = 0;
+}
+
+// escapes are kept as the escaped char, \uXXXX is not decoded
+u8 JsonStream::feed(char ch)
+{
+    switch (mState) {
+        case ST_START:
+            if (ch == '{')
+                mState = ST_KEY_WAIT;
+            else if (!isSpace(ch))
+                mState = ST_ERROR;
+            break;
+
+        case ST_KEY_WAIT:
+            if (ch == '"')
+                mState = ST_KEY;
+            else if (ch == '}')
+                mState = ST_DONE;
+            else if (!isSpace(ch))
+                mState = ST_ERROR;
+            break;
+
+        case ST_KEY:
+            if (mEscape) {
+                mEscape = 0;
+                addChar(mKey, &mKeyLen, sizeof(mKey), ch);
+            } else if (ch == '\\') {
+                mEscape = 1;
+            } else if (ch == '"') {
+                mState = ST_COLON;
+            } else {
+                addChar(mKey, &mKeyLen, sizeof(mKey), ch);
+            }
+            break;
+
+        case ST_COLON:
+            if (ch == ':')
+                mState = ST_VALUE_WAIT;
+            else if (!isSpace(ch))
+                mState = ST_ERROR;
+            break;
+
+        case ST_VALUE_WAIT:
+            if (ch == '"') {
+                mState = ST_STRING;
+            } else if (ch == '{' || ch == '[') {
+                mDepth = 1;
+                mNestedStr = 0;
+                mState = ST_NESTED;
+            } else if (ch == ',' || ch == '}' || ch == ']' || ch == ':') {
+                mState = ST_ERROR;
+            } else if (!isSpace(ch)) {
+                addChar(mValue, &mValueLen, sizeof(mValue), ch);
+                mState = ST_LITERAL;
+            }
+            break;
+
+        case ST_STRING:
+            if (mEscape) {
+                mEscape = 0;
+                addChar(mValue, &mValueLen, sizeof(mValue), ch);
+            } else if (ch == '\\') {
+                mEscape = 1;
+            } else if (ch == '"') {
+                emit(TYPE_STRING);
+                mState = ST_NEXT;
+            } else {
+                addChar(mValue, &mValueLen, sizeof(mValue), ch);
+            }
+            break;
+
+        case ST_LITERAL:
+            if (ch == ',' || ch == '}' || isSpace(ch)) {
+                emit(TYPE_LITERAL);
+                mState = ST_NEXT;
+                return feed(ch);
+            }
+            addChar(mValue, &mValueLen, sizeof(mValue), ch);
+            break;
+
+        case ST_NESTED:
+            if (mNestedStr) {
+                if (mEscape)
+                    mEscape = 0;
+                else if (ch == '\\')
+                    mEscape = 1;
+                else if (ch == '"')
+                    mNestedStr = 0;
+            } else if (ch == '"') {
+                mNestedStr = 1;
+            } else if (ch == '{' || ch == '[') {
+                if (++mDepth == 0)
+                    mState = ST_ERROR;
+            } else if (ch == '}' || ch == ']') {
+                if (--mDepth == 0) {
+                    emit(TYPE_NESTED);
+                    mState = ST_NEXT;
+                }
+            }
+            break;
+
+        case ST_NEXT:
+            if (ch == ',')
+                mState = ST_KEY_WAIT;
+            else if (ch == '}')
+                mState = ST_DONE;
+            else if (!isSpace(ch))
+                mState = ST_ERROR;
+            break;
+
+        case ST_DONE:
+        case ST_ERROR:
+            break;
+    }
+    return getState();
+}
+
+// stops at the end of the object, the bytes after it are not looked at
+u8 JsonStream::feed(u8 *data, int size)
+{
+    u8 ret = getState();
+
+    for (int i = 0; i < size && ret == JSON_MORE; i++)
+        ret = feed((char)data[i]);
+
+    return ret;
+}
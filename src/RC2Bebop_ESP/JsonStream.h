@@ -0,0 +1,78 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _JSON_STREAM_H_
+#define _JSON_STREAM_H_
+
+#include "Common.h"
+
+#define JSON_KEY_LEN    40
+#define JSON_VALUE_LEN  40
+
+// incremental tokenizer for the flat discovery objects, fed as the tcp reads come in.
+// each member is handed to the callback when its value is complete, nested values are skipped.
+// keys and values longer than the buffers are cut.
+class JsonStream
+{
+public:
+    enum {
+        JSON_MORE = 0,      // object not finished yet
+        JSON_DONE,          // closing brace seen
+        JSON_ERROR,
+    };
+
+    enum {
+        TYPE_STRING = 0,
+        TYPE_LITERAL,       // number, true, false, null
+        TYPE_NESTED,        // object or array, value is empty
+    };
+
+    JsonStream();
+
+    void reset(void);
+    u8   feed(char ch);
+    u8   feed(u8 *data, int size);
+    u8   getState(void)     { return (mState == ST_DONE) ? JSON_DONE : (mState == ST_ERROR) ? JSON_ERROR : JSON_MORE; }
+    void setCallback(void (*callback)(char *key, char *value, u8 type))  { mCallback = callback; }
+
+private:
+    enum {
+        ST_START = 0,
+        ST_KEY_WAIT,
+        ST_KEY,
+        ST_COLON,
+        ST_VALUE_WAIT,
+        ST_STRING,
+        ST_LITERAL,
+        ST_NESTED,
+        ST_NEXT,
+        ST_DONE,
+        ST_ERROR,
+    };
+
+    u8   mState;
+    u8   mEscape;
+    u8   mDepth;            // ST_NESTED
+    u8   mNestedStr;        // ST_NESTED, inside a string
+    u8   mKeyLen;
+    u8   mValueLen;
+    char mKey[JSON_KEY_LEN];
+    char mValue[JSON_VALUE_LEN];
+
+    void (*mCallback)(char *key, char *value, u8 type);
+
+    void emit(u8 type);
+    void addChar(char *buf, u8 *len, u8 size, char ch);
+};
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <string.h>
+#include "LinkQuality.h"
+#include "Utils.h"
+#include "Bebop.h"
+
+LinkQuality::LinkQuality()
+{
+    reset();
+}
+
+void LinkQuality::reset(void)
+{
+    memset(mPings, 0, sizeof(mPings));
+    mPingIdx = 0;
+    mPingTS  = 0;
+    mRTT     = 0;
+    mJitter  = 0;
+    mLoss    = 0;
+    mRSSI    = 0;
+    mValid   = false;
+}
+
+// srtt / rttvar as in RFC 6298, loss is an EWMA of lost pings
+void LinkQuality::update(bool lost, u32 rtt)
+{
+    if (lost) {
+        mLoss += (1000 - mLoss) / 16;
+        return;
+    }
+    mLoss -= mLoss / 16;
+
+    if (!mValid) {
+        mRTT    = rtt;
+        mJitter = rtt / 2;
+        mValid  = true;
+    } else {
+        u32 diff = (rtt > mRTT) ? rtt - mRTT : mRTT - rtt;
+
+        mJitter = mJitter - (mJitter / 4) + (diff / 4);
+        mRTT    = mRTT - (mRTT / 8) + (rtt / 8);
+    }
+}
+
+void LinkQuality::expire(u32 us)
+{
+    for (u8 i = 0; i < LINK_PING_SLOTS; i++) {
+        if (mPings[i].us && (us - mPings[i].us) >= LINK_PING_TIMEOUT_MS * 1000UL) {
+            mPings[i].us = 0;
+            update(true, 0);
+        }
+    }
+}
+
+int LinkQuality::buildPing(u8 *buf)
+{
+    u32     us  = micros();
+    PING_T  *p;
+    u8      payload[LINK_PING_LEN];
+
+    expire(us);
+    mPingTS = millis();
+
+    // a slot still in use is a lost ping
+    p = &mPings[mPingIdx];
+    if (p->us)
+        update(true, 0);
+    mPingIdx = (mPingIdx + 1) % LINK_PING_SLOTS;
+
+    p->us   = us ? us : 1;
+    p->sec  = us / 1000000;
+    p->nsec = (us % 1000000) * 1000;
+
+    Utils::put32(&payload[0], p->sec);
+    Utils::put32(&payload[4], p->nsec);
+    return Bebop::buildCmd(buf, FRAME_TYPE_DATA, BUFFER_ID_PING, "P", LINK_PING_LEN, payload);
+}
+
+// true when the pong answers one of our pings, it is not forwarded then
+bool LinkQuality::onPong(u8 *data, u32 size)
+{
+    if (size != LINK_PING_LEN)
+        return false;
+
+    u32 sec  = Utils::get32(&data[0]);
+    u32 nsec = Utils::get32(&data[4]);
+
+    for (u8 i = 0; i < LINK_PING_SLOTS; i++) {
+        PING_T *p = &mPings[i];
+
+        if (p->us && p->sec == sec && p->nsec == nsec) {
+            update(false, micros() - p->us);
+            p->us = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 100 is a clean link, each term takes away its share
+u8 LinkQuality::getQuality(void)
+{
+    s16 q = 100;
+    s16 v;
+
+    expire(micros());
+    if (!mValid)
+        return 0;
+
+    v = (mRTT / 1000);              // ms
+    if (v > 20)
+        q -= min(40, (v - 20) / 2);
+
+    v = (mJitter / 1000);
+    q -= min(20, v / 2);
+
+    q -= min(40, mLoss / 5);        // 2 points per %
+
+    if (mRSSI != 0 && mRSSI < -60)
+        q -= min(30, (-60 - mRSSI) * 2);
+
+    return (q < 0) ? 0 : q;
+}
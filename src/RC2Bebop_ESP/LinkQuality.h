@@ -0,0 +1,63 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _LINK_QUALITY_H_
+#define _LINK_QUALITY_H_
+
+#include "Common.h"
+
+#define LINK_PING_PERIOD_MS     250
+#define LINK_PING_TIMEOUT_MS    1000
+#define LINK_PING_SLOTS         4
+#define LINK_PING_LEN           8       // struct timespec of the drone, sec + nsec
+
+// active ping prober, RTT / jitter in us, loss in 0.1%
+class LinkQuality
+{
+public:
+    LinkQuality();
+
+    void reset(void);
+    bool isPingDue(u32 ts)      { return (ts - mPingTS) >= LINK_PING_PERIOD_MS; }
+    int  buildPing(u8 *buf);
+    bool onPong(u8 *data, u32 size);
+    void onRSSI(s16 rssi)       { mRSSI = rssi; }
+
+    u32  getRTT(void)           { return mRTT;     }
+    u32  getJitter(void)        { return mJitter;  }
+    u16  getLoss(void)          { return mLoss;    }
+    s16  getRSSI(void)          { return mRSSI;    }
+    u8   getQuality(void);
+
+private:
+    typedef struct {
+        u32 sec;
+        u32 nsec;
+        u32 us;                 // micros() at send, 0 = free
+    } PING_T;
+
+    PING_T  mPings[LINK_PING_SLOTS];
+    u8      mPingIdx;
+    u32     mPingTS;
+
+    u32     mRTT;
+    u32     mJitter;
+    u16     mLoss;
+    s16     mRSSI;
+    bool    mValid;
+
+    void    update(bool lost, u32 rtt);
+    void    expire(u32 us);
+};
+
+#endif
@@ -24,6 +24,11 @@ NavServer::NavServer()
     mPort       = 0;
     mNextState  = STATE_HEADER;
     mPayloadLen = 0;
+    mLastRxTS   = 0;
+    mAckCallback = NULL;
+    mDecim      = NULL;
+    mCap        = NULL;
+    setVideoParams(0, 0, -1);
 }
 
 NavServer::NavServer(int port)
@@ -31,6 +36,11 @@ NavServer::NavServer(int port)
     mPort       = port;
     mNextState  = STATE_HEADER;
     mPayloadLen = 0;
+    mLastRxTS   = 0;
+    mAckCallback = NULL;
+    mDecim      = NULL;
+    mCap        = NULL;
+    setVideoParams(0, 0, -1);
 }
 
 NavServer::~NavServer()
@@ -38,6 +48,17 @@ NavServer::~NavServer()
     mUDP.stop();
 }
 
+// negotiated in the discovery, bounds the fragments we reassemble and ack
+void NavServer::setVideoParams(u32 fragSize, u8 fragMax, s32 maxAckInterval)
+{
+    mVidFrameNo     = 0;
+    mVidAckLow      = 0;
+    mVidAckHigh     = 0;
+    mVidFragSize    = fragSize;
+    mVidFragMax     = min(fragMax, (u8)VID_MAX_FRAGS);
+    mVidAckInterval = maxAckInterval;
+}
+
 int NavServer::recv(u8 *data, int size)
 {
     int cb = mUDP.parsePacket();
@@ -57,25 +78,72 @@ static const char *TBL_HREASONS[] = {"userRequest", "connectionLost", "lowBatter
 static const char *TBL_VSTATES[]  = {"stopped", "started", "failed", "autostopped"};
 static const char *TBL_VSSTATES[] = {"enabled", "disabled", "error"};
 
+#define TBL_NAME(tbl, idx, buf)     tblName(tbl, sizeof(tbl) / sizeof(tbl[0]), idx, buf)
+
+// newer firmwares add values, they print as numbers
+static const char *tblName(const char *tbl[], u32 cnt, u32 idx, char *buf)
+{
+    if (idx < cnt)
+        return tbl[idx];
+    sprintf(buf, "%u", idx);
+    return buf;
+}
+
 int NavServer::preProcess(u8 *data, u32 size, u8 *dataAck)
 {
-    return 0;
+    return PRE_PARSE;
+}
+
+// data : arguments after prj, cls, cmd
+void NavServer::printPilotingState(u16 cmd, u8 *data, u32 size)
+{
+    ByteBuffer  ba(data, size);
+    char        buf[32];
+
+    switch(cmd) {
+        case 4:
+            if (size >= 24)
+                Utils::printf(">> POS          : %s %s %s\n", Utils::dtoa(buf, ba.getdouble()),
+                    Utils::dtoa(buf, ba.getdouble()), Utils::dtoa(buf, ba.getdouble()));
+            break;
+
+        case 5:
+            if (size >= 12)
+                Utils::printf(">> SPEED        : %s %s %s\n", Utils::ftoa(buf, ba.getfloat()),
+                    Utils::ftoa(buf, ba.getfloat()), Utils::ftoa(buf, ba.getfloat()));
+            break;
+
+        case 6:
+            if (size >= 12)
+                Utils::printf(">> ANGLE        : %s %s %s\n", Utils::ftoa(buf, ba.getfloat()),
+                    Utils::ftoa(buf, ba.getfloat()), Utils::ftoa(buf, ba.getfloat()));
+            break;
+
+        case 8:
+            if (size >= 8)
+                Utils::printf(">> ALT          : %s\n", Utils::dtoa(buf, ba.getdouble()));
+            break;
+    }
 }
 
 int NavServer::parseFrame(u8 *data, u32 size, u8 *dataAck)
 {
     ByteBuffer   ba(data, size);
     char        buf[32];
+    char        buf2[12];
     u32         cmdID;
     u16         cmd;
     int         len = 0;
 
-    len = preProcess(data, size, dataAck);
-    if (len < 0)
-        return -len;
+    mLastRxTS = millis();
+    mSeqState = mSeq.check(mFrameID, mFrameSeqID);
+    if (preProcess(data, size, dataAck) == PRE_CONSUMED)
+        return 0;
 
     switch (mFrameType) {
         case FRAME_TYPE_ACK:
+            if (mAckCallback && size >= 1)
+                (*mAckCallback)(mFrameID & 0x7f, *data);
             if (mPayloadLen == 8 && mFrameID == 0x8b) {
                 Utils::printf(">> ACKACK       : %d\n", *data);
                 len = Bebop::buildCmd(dataAck, FRAME_TYPE_ACK, 0xFE, "B", mFrameSeqID);
@@ -83,34 +151,50 @@ int NavServer::parseFrame(u8 *data, u32 size, u8 *dataAck)
             return len;
 
         case FRAME_TYPE_DATA_LOW_LATENCY:
-            if (mPayloadLen >= 12 && mFrameID == BUFFER_ID_D2C_VID) {
+            if (size >= VID_FRAG_HDR_LEN && mFrameID == BUFFER_ID_D2C_VID) {
                 u16 frameNo      = ba.get16();
                 u8  frameFlags   = ba.get8();
                 u8  fragNo       = ba.get8();
                 u8  fragPerFrame = ba.get8();
-                static u64 ackLow;
-                static u64 ackHigh;
+                u8  fragMax      = mVidFragMax ? mVidFragMax : VID_MAX_FRAGS;
+
+                if (mVidAckInterval == 0)
+                    return len;
+
+                if (fragNo >= fragMax || fragPerFrame > fragMax ||
+                    (mVidFragSize && size - VID_FRAG_HDR_LEN > mVidFragSize)) {
+                    Utils::printf(">> VIDEO BAD    : %05d, %03d, %03d, %d\n", frameNo, fragNo, fragPerFrame, size);
+                    return len;
+                }
 
                 if (frameNo != mVidFrameNo) {
-                    ackLow  = 0;
-                    ackHigh = 0;
+                    mVidAckLow  = 0;
+                    mVidAckHigh = 0;
                     mVidFrameNo = frameNo;
                 }
 
                 if (fragNo < 64)
-                    ackLow |= (1 << fragNo);
+                    mVidAckLow  |= ((u64)1 << fragNo);
                 else
-                    ackHigh |= (1 << (fragNo - 64));
+                    mVidAckHigh |= ((u64)1 << (fragNo - 64));
 
                 Utils::printf(">> VIDEO        : %05d, %02X, %03d, %03d\n", frameNo, frameFlags, fragNo, fragPerFrame);
-                len = Bebop::buildCmd(dataAck, FRAME_TYPE_DATA, 13, "HQQ", frameNo, ackHigh, ackLow);
+                len = Bebop::buildCmd(dataAck, FRAME_TYPE_DATA, BUFFER_ID_C2D_VID_ACK, "HQQ", frameNo, mVidAckHigh, mVidAckLow);
             }
             return len;
 
         case FRAME_TYPE_DATA_WITH_ACK:
-            Utils::printf(">> ACK REQUIRED : %d %d %d\n", mFrameType, mFrameID, mFrameSeqID);
+            // retransmits are acked again but not parsed again, only the settings buffer is parsed
             len = Bebop::buildCmd(dataAck, FRAME_TYPE_ACK, 0x80 | mFrameID, "B", mFrameSeqID);
-            return len;
+            if (mSeqState == SeqTracker::SEQ_DUP || mSeqState == SeqTracker::SEQ_STALE) {
+                Utils::printf(">> ACK DUP      : %d %d\n", mFrameID, mFrameSeqID);
+                return len;
+            }
+            if (mFrameID != BUFFER_ID_D2C_ACK_SETTINGS) {
+                Utils::printf(">> ACK REQUIRED : %d %d %d\n", mFrameType, mFrameID, mFrameSeqID);
+                return len;
+            }
+            break;
     }
 
     switch(mFrameID) {
@@ -128,26 +212,9 @@ int NavServer::parseFrame(u8 *data, u32 size, u8 *dataAck)
             } else if (cmdID == PACK_CMD(PROJECT_ARDRONE3, ARDRONE3_CLASS_CAMERASTATE, 0)) {
                 Utils::printf(">> CAM          : %d %d\n", ba.get8(), ba.get8());
             } else if (GET_PRJ_CLS(cmdID) == PACK_PRJ_CLS(PROJECT_ARDRONE3, ARDRONE3_CLASS_PILOTINGSTATE)) {
-                switch(cmd) {
-                    case 4:
-                        Utils::printf(">> POS          : %s %s %s\n", Utils::dtoa(buf, ba.getdouble()),
-                            Utils::dtoa(buf, ba.getdouble()), Utils::dtoa(buf, ba.getdouble()));
-                        break;
-
-                    case 5:
-                        Utils::printf(">> SPEED        : %s %s %s\n", Utils::ftoa(buf, ba.getfloat()),
-                            Utils::ftoa(buf, ba.getfloat()), Utils::ftoa(buf, ba.getfloat()));
-                        break;
-
-                    case 6:
-                        Utils::printf(">> ANGLE        : %s %s %s\n", Utils::ftoa(buf, ba.getfloat()),
-                            Utils::ftoa(buf, ba.getfloat()), Utils::ftoa(buf, ba.getfloat()));
-                        break;
-
-                    case 8:
-                        Utils::printf(">> ALT          : %s\n", Utils::dtoa(buf, ba.getdouble()));
-                        break;
-                }
+                // the log sink of the decimator prints them at its own rate
+                if (!mDecim || !mDecim->put(cmdID, mBuffer, mPayloadLen))
+                    printPilotingState(cmd, &data[4], size - 4);
             } else {
                 Utils::printf(">> UNKNOWN      : %08x\n", cmdID);
             }
@@ -242,16 +309,21 @@ int NavServer::parseFrame(u8 *data, u32 size, u8 *dataAck)
                             break;
 
                         case 1:
-                            Utils::printf(">> Flying State : %s\n", TBL_FSTATES[ba.get32()]);
+                            Utils::printf(">> Flying State : %s\n", TBL_NAME(TBL_FSTATES, ba.get32(), buf));
                             break;
 
                         case 2:
-                            Utils::printf(">> Alert  State : %s\n", TBL_ASTATES[ba.get32()]);
+                            Utils::printf(">> Alert  State : %s\n", TBL_NAME(TBL_ASTATES, ba.get32(), buf));
                         break;
 
-                        case 3:
-                            Utils::printf(">> Navigate Home: %s, %s\n", TBL_HSTATES[ba.get32()], TBL_HREASONS[ba.get32()]);
+                        case 3: {
+                            u32 state  = ba.get32();
+                            u32 reason = ba.get32();
+
+                            Utils::printf(">> Navigate Home: %s, %s\n", TBL_NAME(TBL_HSTATES, state, buf),
+                                TBL_NAME(TBL_HREASONS, reason, buf2));
                             break;
+                        }
 
                         default:
                             Utils::printf(">> UNKNOWN PILOT: %08x\n", cmdID);
@@ -286,7 +358,7 @@ int NavServer::parseFrame(u8 *data, u32 size, u8 *dataAck)
                             break;
                             
                         case 1:
-                            Utils::printf(">> Video  State : %s %d\n", TBL_VSTATES[ba.get32()], ba.get8());
+                            Utils::printf(">> Video  State : %s %d\n", TBL_NAME(TBL_VSTATES, ba.get32(), buf), ba.get8());
                             break;
 
                         default:
@@ -323,7 +395,7 @@ int NavServer::parseFrame(u8 *data, u32 size, u8 *dataAck)
 
                 case PACK_PRJ_CLS(PROJECT_ARDRONE3, ARDRONE3_CLASS_MEDIASTREAMINGSTATE):
                     if (cmd == 0) {
-                        Utils::printf(">> VideoStm Stat: %s\n", TBL_VSSTATES[ba.get32()]);
+                        Utils::printf(">> VideoStm Stat: %s\n", TBL_NAME(TBL_VSSTATES, ba.get32(), buf));
                     }
                     break;
 
@@ -378,6 +450,9 @@ int NavServer::process(u8 *dataAck)
     int len = 0;
     int size = 0;
 
+    // one entry per datagram, the frames are appended as they are read
+    if (cb > 0 && mCap)
+        mCap->open(mUDP.remoteIP(), mUDP.remotePort(), mUDP.destinationIP(), mPort, this);
     cb = mUDP.available();
    
     while (cb > 0) {
@@ -389,6 +464,8 @@ int NavServer::process(u8 *dataAck)
 
                 mUDP.read(mBuffer, HEADER_LEN);
                 u8 *data = mBuffer;
+                if (mCap)
+                    mCap->append(mBuffer, HEADER_LEN, this);
 
                 //Utils::printf(">> RX --- \n");
                 //Utils::dump(data, HEADER_LEN);
@@ -398,8 +475,15 @@ int NavServer::process(u8 *dataAck)
                 mFrameID    = ba.get8();
                 mFrameSeqID = ba.get8();
                 mPayloadLen = ba.get32();
-                mNextState = STATE_BODY;
                 cb -= HEADER_LEN;
+
+                // broken length, the rest of the datagram is dropped by the next parsePacket
+                if (mPayloadLen < HEADER_LEN || mPayloadLen > sizeof(mBuffer)) {
+                    Utils::printf(">> BAD LENGTH   : %d %d %d\n", mFrameType, mFrameID, mPayloadLen);
+                    badFrame();
+                    return size;
+                }
+                mNextState = STATE_BODY;
             }
             // no break
 
@@ -411,6 +495,8 @@ int NavServer::process(u8 *dataAck)
                     return len;
 
                 mUDP.read(&mBuffer[HEADER_LEN], bodylen);
+                if (mCap)
+                    mCap->append(&mBuffer[HEADER_LEN], bodylen, this);
                 //Utils::dump(&mBuffer[HEADER_LEN], bodylen);
                 len = parseFrame(&mBuffer[HEADER_LEN], bodylen, dataAck);
                 dataAck += len;
@@ -422,6 +508,8 @@ int NavServer::process(u8 *dataAck)
             break;
         }
     }
+    if (mCap)
+        mCap->commit();
 
     return size;
 }
@@ -12,13 +12,18 @@
 */
 
 #ifndef _NAV_SERVER_H_
-#define _NAV_SERVER__H_
+#define _NAV_SERVER_H_
 
 #include <WiFiUdp.h>
 #include "Common.h"
 #include "Bebop.h"
+#include "SeqTracker.h"
+#include "Decimator.h"
+#include "Capture.h"
 
 #define HEADER_LEN  7
+#define VID_FRAG_HDR_LEN    5       // frameNo(2), flags, fragNo, fragPerFrame
+#define VID_MAX_FRAGS       128     // ack bitmap, 2 x u64
 
 // http://robotika.cz/robots/katarina/en#150202
 // https://github.com/robotika/katarina
@@ -33,6 +38,12 @@ public:
         STATE_BODY   = 1,
     };
 
+    // preProcess verdicts
+    enum {
+        PRE_PARSE = 0,          // the parser takes it from here
+        PRE_CONSUMED,           // handled or forwarded, nothing to parse nor to ack
+    };
+
 
     NavServer();
     NavServer(int port);
@@ -44,11 +55,19 @@ public:
     int     process(u8 *dataAck);
     u8      *getData(void)     { return mBuffer;       }
     u32     getDataSize(void)  { return mPayloadLen;   }
+    u32     getLastRxTS(void)  { return mLastRxTS;     }
+    void    resetSeq(void)     { mSeq.reset();         }
 
     virtual int preProcess(u8 *data, u32 size, u8 *dataAck);
+    void    setAckCallback(void (*callback)(u8 id, u8 seq))   { mAckCallback = callback; }
+    void    setVideoParams(u32 fragSize, u8 fragMax, s32 maxAckInterval);
+    void    setDecimator(Decimator *decim)  { mDecim = decim; }
+    void    setCapture(Capture *cap)        { mCap = cap; }
+    static void printPilotingState(u16 cmd, u8 *data, u32 size);
 
 protected:
     int parseFrame(u8 *data, u32 size, u8 *dataAck);
+    virtual void badFrame(void) { }
 
     WiFiUDP mUDP;
     int mPort;
@@ -60,8 +79,21 @@ protected:
     u8  mFrameID;
     u8  mFrameSeqID;
     u32 mPayloadLen;
+    u32 mLastRxTS;
+
+    SeqTracker mSeq;
+    u8  mSeqState;
 
     u16 mVidFrameNo;
+    u64 mVidAckLow;
+    u64 mVidAckHigh;
+    u32 mVidFragSize;       // 0 : not known
+    u8  mVidFragMax;        // 0 : not known
+    s32 mVidAckInterval;    // 0 : no video acks, -1 : stream default
+
+    void (*mAckCallback)(u8 id, u8 seq);
+    Decimator *mDecim;
+    Capture *mCap;
 };
 
 #endif
@@ -7,6 +7,20 @@
 #include "ByteBuffer.h"
 #include "SerialProtocol.h"
 #include "BridgeServer.h"
+#include "RCCurve.h"
+#include "LinkQuality.h"
+#include "VideoThrottle.h"
+#include "ClockSync.h"
+#include "Stats.h"
+#include "StateCache.h"
+#include "Session.h"
+#include "JsonStream.h"
+#include "TcpLink.h"
+#include "Decimator.h"
+#include "Telemetry.h"
+#include "Recorder.h"
+#include "Capture.h"
+#include "SeqSplice.h"
 
 extern "C" {
 #include "user_interface.h"
@@ -19,24 +33,91 @@ enum {
     STATE_DISCOVERY_ACK,
     STATE_CONFIG,
     STATE_WORK,
+    STATE_RECONNECT,        // channel / bssid locked join with the last session
+    STATE_RESUME,           // joined again, waiting for the drone to go on with the old session
 };
 
 #define DISCOVERY_PORT      44444
 #define BRG_CMD_SERVER_PORT 51000
 #define BRG_NAV_SERVER_PORT 52000
 
+#define AP_CONNECT_TIMEOUT_MS   10000   // join after the scan, then scan again
+#define RECONNECT_TIMEOUT_MS    3000    // direct join, then a full scan
+#define RESUME_TIMEOUT_MS       1000    // no drone traffic after the join, then a new discovery
+#define DISCOVERY_CONNECT_MS    1000
+#define DISCOVERY_ANSWER_MS     2000
+#define DISCOVERY_RETRY_MS      500
+
+#define FAILSAFE_ACTION     BridgeServer::FAILSAFE_HOVER
+#define MIX_POLICY          BridgeServer::MIX_RC_ACTIVE
+#define SUB_FILTER          BridgeServer::SUB_NO_VIDEO     // apps after the pilot one
+#define SUB_RATE            32768                           // bytes/s for them
+
+// decimator sinks
+enum {
+    SINK_LOG = 0,
+    SINK_AVR,
+    SINK_REC,
+    SINK_SUB,           // watching apps, one sink each after the pilot
+};
+
+#define LOG_REPORT_HZ       2
+
+#define TELEMETRY_PERIOD_MS 250     // to the AVR
+#define TELEMETRY_RC_GAP_MS 100     // no RC frame to follow for that long, send anyway
+#define SUB_REPORT_HZ       5
+#define REC_REPORT_HZ       10
+#define REC_TELEMETRY_MS    500     // telemetry and link records
+
 static SerialProtocol   mSerial;
-static WiFiClient       mBebopDiscoveryClient;
+static TcpConn          mBebopDiscovery;
+static u32              mDiscoveryTS;
+static u8               mDiscoveryTries;
+static bool             mDiscoverySent;
 
 static u8               mNextState = STATE_INIT;
-static char             mStrDiscovery2App[200];
+static char             mStrDiscovery2App[SESSION_DISCOVERY_LEN];
+static char             mStrDiscoveryNext[SESSION_DISCOVERY_LEN];    // built while the drone answers
+static int              mDiscoveryNextLen;
+static JsonStream       mBebopJson;
+static JsonStream       mAppJson;
+static s32              mDroneStatus;
+static u16              mDroneC2DPort;
+static u16              mAppD2CPort;
+static u32              mVidFragSize;
+static u8               mVidFragMax;
+static s32              mVidAckInterval;
 
 static BridgeServer     mCmdBridge("CMD_BRG", BRG_CMD_SERVER_PORT);
 static BridgeServer     mNavBridge("NAV_BRG", BRG_NAV_SERVER_PORT);
+static RCCurve          mCurve;
+static LinkQuality      mLink;
+static VideoThrottle    mVideo;
+static ClockSync        mClock;
+static Stats            mStats;
+static StateCache       mCache;
+static SeqSplice        mSplice(BUFFER_ID_C2D_SETTINGS);
+static SeqSplice        mPCMDSplice(BUFFER_ID_C2D_PCMD);
+static Commands         mControl;
+static Session          mSession;
+static Decimator        mDecim;
+static Telemetry        mTelem;
+static u32              mTelemTS;
+static Recorder         mRec;
+static Capture          mCap;
+static u32              mRecTS;
+static u8               mRecState = 0xff;
+static u32              mRCFrameTS;
+static bool             mRCGap;         // RC frame just taken, the AVR waits for the next one
+
+static u32              mLostTS;        // wifi lost
+static u32              mJoinTS;        // join issued, 0 for not yet
+static u32              mResumeTS;
+static bool             mAppLinked;     // app side is up, it stays up over a drone drop
+static int              mAppSub;        // subscriber of the last app discovery, 0 is the pilot
 
 static u8          mac[20];
-static WiFiServer  mAppDiscoveryServer(DISCOVERY_PORT);
-static WiFiClient  mAppDiscoveryClient;
+static TcpListener mAppDiscovery(DISCOVERY_PORT);
 
 
 void WiFiEvent(WiFiEvent_t event) {
@@ -46,14 +127,25 @@ void WiFiEvent(WiFiEvent_t event) {
         case WIFI_EVENT_STAMODE_GOT_IP:
             Serial.println("WiFi connected");
             Utils::printf("IP address: %s\n", WiFi.localIP().toString().c_str());
-            mNextState = STATE_DISCOVERY;
+            if (mNextState == STATE_RECONNECT) {
+                mResumeTS  = millis();
+                mNextState = STATE_RESUME;
+            } else {
+                mNextState = STATE_DISCOVERY;
+            }
             mSerial.sendCmd(SerialProtocol::CMD_SET_STATE, &mNextState, 1);
             break;
 
 
         case WIFI_EVENT_STAMODE_DISCONNECTED:
+            // failed join attempts, the timeouts take care of them
+            if (mNextState <= STATE_AP_CONNECT || mNextState == STATE_RECONNECT)
+                break;
+
             Utils::printf("WiFi lost connection\n");
-            mNextState = STATE_INIT;
+            mLostTS = millis();
+            mJoinTS = 0;
+            mNextState = mSession.isValid() ? STATE_RECONNECT : STATE_INIT;
             mSerial.sendCmd(SerialProtocol::CMD_SET_STATE, &mNextState, 1);
             break;
     }
@@ -155,7 +247,6 @@ bool bebop_scanAndConnect(void)
         for (int i = 0; i < n; i++) {
             Utils::printf("%d : %s (%d) %d\n", i + 1, WiFi.SSID(i).c_str(), WiFi.RSSI(i), WiFi.encryptionType(i));
             if (!strncmp(WiFi.SSID(i).c_str(), "BebopDrone", 10)) {
-                WiFi.onEvent(WiFiEvent);
                 WiFi.begin(WiFi.SSID(i).c_str(), "");
                 Utils::printf("Connect to BebopDrone !!!\n");
                 mSerial.sendCmd(SerialProtocol::CMD_SET_STATE, &mNextState, 1);
@@ -166,89 +257,295 @@ bool bebop_scanAndConnect(void)
     return false;
 }
 
+// no scan, no dhcp : same ap on the same channel with the address it gave us last time
+void bebop_directJoin(void)
+{
+    Utils::printf("Reconnect to %s ch:%d %s\n", mSession.getSSID(), mSession.getChannel(), mSession.getIP().toString().c_str());
+    WiFi.config(mSession.getIP(), mSession.getGateway(), mSession.getSubnet());
+    WiFi.begin(mSession.getSSID(), "", mSession.getChannel(), mSession.getBSSID());
+}
+
+void bebop_reconnected(bool resumed)
+{
+    u32 ms = millis() - mLostTS;
+
+    Utils::printf("RECONNECTED in %d ms (%s)\n", ms, resumed ? "resumed" : "new session");
+    mStats.addReconnect(ms, resumed);
+}
+
+// appends a member to our next answer for the app, what does not fit is left out.
+// room for the closing brace is always kept
+static void appendDiscovery(const char *fmt, ...)
+{
+    int     room = sizeof(mStrDiscoveryNext) - 2 - mDiscoveryNextLen;
+    int     n;
+    va_list ap;
+
+    va_start(ap, fmt);
+    n = vsnprintf(&mStrDiscoveryNext[mDiscoveryNextLen], room, fmt, ap);
+    va_end(ap);
+
+    if (n > 0 && n < room)
+        mDiscoveryNextLen += n;
+    else
+        mStrDiscoveryNext[mDiscoveryNextLen] = 0;
+}
+
+//{ "status": 0, "c2d_port": 54321, "arstream_fragment_size": 65000, "arstream_fragment_maximum_number": 4, "arstream_max_ack_interval": -1, "c2d_update_port": 51, "c2d_user_port": 21 }
+void bebopJsonCallback(char *key, char *value, u8 type)
+{
+    char    sv[20];
+    s32     v = atoi(value);
+
+    Utils::printf("bebop discovery %s : %s\n", key, value);
+    if (!strcmp(key, "status")) {
+        mDroneStatus = v;
+    } else if (!strcmp(key, "c2d_port")) {
+        mDroneC2DPort = v;
+        value = itoa(BRG_CMD_SERVER_PORT, sv, 10);     // the app talks to us
+    } else if (!strcmp(key, "arstream_fragment_size")) {
+        mVidFragSize = v;
+    } else if (!strcmp(key, "arstream_fragment_maximum_number")) {
+        mVidFragMax = constrain(v, 0, VID_MAX_FRAGS);
+    } else if (!strcmp(key, "arstream_max_ack_interval")) {
+        mVidAckInterval = v;
+    }
+
+    if (type == JsonStream::TYPE_NESTED)
+        return;
+
+    appendDiscovery((type == JsonStream::TYPE_STRING) ? "%s\"%s\": \"%s\"" : "%s\"%s\": %s",
+        (mDiscoveryNextLen > 2) ? ", " : "", key, value);
+}
+
+void bebop_resetDiscovery(void)
+{
+    mBebopJson.reset();
+    mBebopJson.setCallback(bebopJsonCallback);
+    mDroneStatus    = -1;
+    mDroneC2DPort   = 0;
+    mVidFragSize    = 0;
+    mVidFragMax     = 0;
+    mVidAckInterval = -1;
+
+    mDiscoveryNextLen = 0;
+    appendDiscovery("{ ");
+}
+
+// starts the connect, bebop_handleDiscovery takes it from there
 bool bebop_connectDiscovery(void)
 {
     IPAddress hostIP = WiFi.localIP();
     hostIP[3] = 1;
 
-    WiFi.removeEvent(WiFiEvent);
-    Utils::printf("bebop_connectDiscovery : %s, %d\n", hostIP.toString().c_str(), DISCOVERY_PORT);
-    if (!mBebopDiscoveryClient.connect(hostIP, DISCOVERY_PORT)) {
+    if (mDiscoveryTries > 0 && millis() - mDiscoveryTS < DISCOVERY_RETRY_MS)
+        return false;
+
+    Utils::printf("bebop_connectDiscovery : %s, %d (%d)\n", hostIP.toString().c_str(), DISCOVERY_PORT, mDiscoveryTries);
+    mDiscoveryTS   = millis();
+    mDiscoverySent = false;
+    mDiscoveryTries++;
+    if (!mBebopDiscovery.connect(hostIP, DISCOVERY_PORT)) {
         Utils::printf("Connection Failed !!!\n");
-    } else {
-        char req[200];
-        sprintf(req,"{\"d2c_port\":%d, \"controller_name\":\"UniConTX\", \"controller_type\":\"computer\"}", BRG_NAV_SERVER_PORT);
-        Utils::printf("to bebop : %s\n", req);
-        mBebopDiscoveryClient.print(req);
-        mBebopDiscoveryClient.flush();
-        mSerial.sendCmd(SerialProtocol::CMD_SET_STATE, &mNextState, 1);
-        return true;
+        return false;
     }
+    bebop_resetDiscovery();
+    mSerial.sendCmd(SerialProtocol::CMD_SET_STATE, &mNextState, 1);
 
-    return false;
+    return true;
 }
 
-bool bebop_handleDiscovery(void)
+static void bebop_failDiscovery(const char *reason)
 {
-    u8      buf[256];
-    char    sv[20];
+    Utils::printf("discovery failed : %s !!\n", reason);
+    mBebopDiscovery.close();
+    mDiscoveryTS = millis();
+    mNextState   = STATE_DISCOVERY;
+}
 
-    Utils::printf("Waiting response !!!\n");
-    while (mBebopDiscoveryClient.available()) {
-        int len = mBebopDiscoveryClient.read(buf, 256);
-        if (len > 0) {
-            Utils::printf("%d %s\n", len, (char*)buf);
-            //{ "status": 0, "c2d_port": 54321, "arstream_fragment_size": 65000, "arstream_fragment_maximum_number": 4, "arstream_max_ack_interval": -1, "c2d_update_port": 51, "c2d_user_port": 21 }            
-
-            char *ptr = strstr((char*)buf, "\"c2d_port\":");
-            if (ptr) {
-                ptr += strlen("\"c2d_port\":");
-                char *comma = strstr(ptr, ",");
-                char szPort[20];
-                
-                strncpy(szPort, ptr, comma - ptr);
-                szPort[comma - ptr] = 0;
-                int port = atoi(szPort);
-                Utils::printf("dev command (c2d_port):%d !!\n", port);
-                mCmdBridge.setDest(mBebopDiscoveryClient.remoteIP(), port);
-
-                memset(mStrDiscovery2App, 0, sizeof(mStrDiscovery2App));
-                strncpy(mStrDiscovery2App, (char*)buf, ptr - (char*)&buf[0]);
-                strcat(mStrDiscovery2App, itoa(BRG_CMD_SERVER_PORT, sv, 10));
-                strcat(mStrDiscovery2App, comma);
-                Utils::printf("prepare App discovery msg (c2d_port):%s !!\n", mStrDiscovery2App);
-                mBebopDiscoveryClient.stop();
+// one step per call : connect, send the request, take what came of the answer
+bool bebop_handleDiscovery(void)
+{
+    u8      buf[64];
+    u8      ret;
+    int     len;
+
+    switch (mBebopDiscovery.getState()) {
+        case TcpConn::TCP_CONNECTING:
+            if (millis() - mDiscoveryTS > DISCOVERY_CONNECT_MS)
+                bebop_failDiscovery("connect timeout");
+            return false;
+
+        case TcpConn::TCP_CONNECTED:
+            if (!mDiscoverySent) {
+                char req[200];
+                sprintf(req,"{\"d2c_port\":%d, \"controller_name\":\"UniConTX\", \"controller_type\":\"computer\"}", BRG_NAV_SERVER_PORT);
+                Utils::printf("to bebop : %s\n", req);
+                if (!mBebopDiscovery.write(req)) {
+                    bebop_failDiscovery("send");
+                    return false;
+                }
+                mDiscoverySent = true;
+                mDiscoveryTS   = millis();
+                return false;
             }
-            mSerial.sendCmd(SerialProtocol::CMD_SET_STATE, &mNextState, 1);
-            return true;
-        }
-        
+            break;
+
+        case TcpConn::TCP_CLOSED:
+            // the answer may still be in the ring
+            break;
+
+        default:
+            bebop_failDiscovery("connection");
+            return false;
     }
 
-    return false;
+    len = mBebopDiscovery.read(buf, sizeof(buf));
+    ret = mBebopJson.feed(buf, len);
+
+    if (ret == JsonStream::JSON_MORE) {
+        if (mBebopDiscovery.getState() == TcpConn::TCP_CLOSED && mBebopDiscovery.available() == 0)
+            bebop_failDiscovery("closed");
+        else if (millis() - mDiscoveryTS > DISCOVERY_ANSWER_MS)
+            bebop_failDiscovery("answer timeout");
+        return false;
+    }
+
+    IPAddress droneIP = mBebopDiscovery.remoteIP();
+
+    mBebopDiscovery.close();
+    if (ret == JsonStream::JSON_ERROR || mDroneStatus != 0 || mDroneC2DPort == 0) {
+        Utils::printf("bad discovery answer, status:%d c2d_port:%d !!\n", mDroneStatus, mDroneC2DPort);
+        bebop_failDiscovery("answer");
+        return false;
+    }
+    strcpy(&mStrDiscoveryNext[mDiscoveryNextLen], " }");
+    strcpy(mStrDiscovery2App, mStrDiscoveryNext);
+    mDiscoveryTries = 0;
+
+    Utils::printf("dev command (c2d_port):%d !!\n", mDroneC2DPort);
+    mCmdBridge.setDest(droneIP, mDroneC2DPort);
+    mControl.setDest(droneIP, mDroneC2DPort);
+    mNavBridge.setVideoParams(mVidFragSize, mVidFragMax, mVidAckInterval);
+    mCmdBridge.setVideoParams(mVidFragSize, mVidFragMax, mVidAckInterval);
+
+    Utils::printf("prepare App discovery msg (c2d_port):%s !!\n", mStrDiscovery2App);
+    mSession.save(mDroneC2DPort, mStrDiscovery2App);
+    mSerial.sendCmd(SerialProtocol::CMD_SET_STATE, &mNextState, 1);
+
+    return true;
+}
+
+void decimCallback(u8 sink, u32 cmdID, u8 *frame, u8 size)
+{
+    if (sink == SINK_LOG)
+        NavServer::printPilotingState(GET_CMD(cmdID), &frame[CLASSIFY_LEN], size - CLASSIFY_LEN);
+    else if (sink == SINK_REC)
+        mRec.add(Recorder::REC_REPORT, &frame[CLASSIFY_LEN], size - CLASSIFY_LEN);
+    else if (sink >= SINK_SUB)
+        mNavBridge.deliver(sink, frame, size);
+}
+
+void tapCallback(u8 *frame, u32 size)
+{
+    mTelem.onFrame(frame, size);
+}
+
+// right after an RC frame the line from the AVR is quiet for most of the frame period
+void sendTelemetry(void)
+{
+#ifndef __SBUS_LINK__
+    u32 ts = millis();
+    u8  buf[TELEMETRY_LEN];
+    u8  flags = 0;
+
+    if (ts - mTelemTS < TELEMETRY_PERIOD_MS || !mSerial.isIdle())
+        return;
+    if (!mRCGap && ts - mRCFrameTS < TELEMETRY_RC_GAP_MS)
+        return;
+
+    if (mNextState >= STATE_CONFIG && ts - mNavBridge.getLastRxTS() < 1000)
+        flags |= TELEMETRY_LINK_UP;
+    if (mCmdBridge.isFailsafe())
+        flags |= TELEMETRY_FAILSAFE;
+
+    mSerial.sendCmd(SerialProtocol::CMD_SET_TELEMETRY, buf, mTelem.build(buf, flags, mNavBridge.getSubscriberCnt()));
+    mTelemTS = ts;
+    mRCGap   = false;
+#endif
 }
 
-s16 map(s16 v)
+// state changes, then telemetry and link every REC_TELEMETRY_MS. the reports come from the decimator
+void recordFlight(void)
 {
-    return (-5 <= v && v <= 5) ? 0 : v;
+    u32 ts = millis();
+    u8  buf[16];
+    u8  flags = 0;
+    int idx;
+
+    if (!mRec.isOpen())
+        return;
+
+    if (mRecState != mNextState) {
+        mRecState = mNextState;
+        mRec.add(Recorder::REC_STATE, &mRecState, 1);
+    }
+
+    if (ts - mRecTS >= REC_TELEMETRY_MS) {
+        if (mNextState >= STATE_CONFIG && ts - mNavBridge.getLastRxTS() < 1000)
+            flags |= TELEMETRY_LINK_UP;
+        if (mCmdBridge.isFailsafe())
+            flags |= TELEMETRY_FAILSAFE;
+        mRec.add(Recorder::REC_TELEMETRY, buf, mTelem.build(buf, flags, mNavBridge.getSubscriberCnt()));
+
+        idx  = Utils::put32(&buf[0], mLink.getRTT());
+        idx += Utils::put32(&buf[idx], mLink.getJitter());
+        idx += Utils::put16(&buf[idx], mLink.getLoss());
+        idx += Utils::put16(&buf[idx], mLink.getRSSI());
+        buf[idx++] = mLink.getQuality();
+        mRec.add(Recorder::REC_LINK, buf, idx);
+        mRecTS = ts;
+    }
+    mRec.poll();
+}
+
+void ackCallback(u8 id, u8 seq)
+{
+    mControl.onAck(id, seq);
 }
 
 u32 serialCallback(u8 cmd, u8 *data, u8 size)
 {
     u8 flag = 0;
+    u8 status;
     u32 ret = 0;
+    s16 rc[8];
     ByteBuffer bb(data, size);
 
     switch (cmd) {
         case SerialProtocol::CMD_SET_RC:
-            speed = map((s16)bb.get16());
-            yaw   = map((s16)bb.get16());
-            pitch = map((s16)bb.get16());
-            roll  = map((s16)bb.get16());
-            aux1  = map((s16)bb.get16());
-            aux2  = map((s16)bb.get16());
-            aux3  = map((s16)bb.get16());
-            aux4  = map((s16)bb.get16());
+            // PPM receivers may report less than 8 channels, status byte follows the channels
+            memset(rc, 0, sizeof(rc));
+            for (u8 i = 0; i < 8 && i < size / 2; i++)
+                rc[i] = mCurve.apply(i, (s16)bb.get16());
+            status = (size & 1) ? data[size - 1] : 0;
+
+            speed = rc[0];
+            yaw   = rc[1];
+            pitch = rc[2];
+            roll  = rc[3];
+            aux1  = rc[4];
+            aux2  = rc[5];
+            aux3  = rc[6];
+            aux4  = rc[7];
+
+            if (roll != 0 || pitch != 0)
+                flag = 1;
+            mCmdBridge.move(flag, roll, pitch, yaw, speed);
+            mCmdBridge.setFailsafe(status & RC_STATUS_FAILSAFE);
+            mRec.addRC(rc, 8, status);
+            mRCFrameTS = millis();
+            mRCGap     = true;
 
 #if 0
             if (aux1 >= 50)
@@ -262,6 +559,21 @@ u32 serialCallback(u8 cmd, u8 *data, u8 size)
             mControl.move(flag, roll, pitch, yaw, speed);
 #endif
             break;
+
+        case SerialProtocol::CMD_SET_CURVE:
+            // ch, expo, rate, deadband, trim, reverse
+            if (size >= 6) {
+                CURVE_T curve;
+                u8      ch = bb.get8();
+
+                curve.expo     = (s8)bb.get8();
+                curve.rate     = bb.get8();
+                curve.deadband = bb.get8();
+                curve.trim     = (s8)bb.get8();
+                curve.reverse  = bb.get8();
+                mCurve.setCurve(ch, &curve);
+            }
+            break;
     }
     return ret;
 }
@@ -276,6 +588,54 @@ void setupNetwork(void)
 
     Utils::printf("\n\nReady !!! : %08x\n", ESP.getChipId());
     mSerial.setCallback(serialCallback);
+    mCmdBridge.setFailsafeAction(FAILSAFE_ACTION);
+    mCmdBridge.setMixPolicy(MIX_POLICY);
+    mCmdBridge.setLinkQuality(&mLink);
+    mNavBridge.setLinkQuality(&mLink);
+    mCmdBridge.setVideoThrottle(&mVideo);
+    mNavBridge.setVideoThrottle(&mVideo);
+    mCmdBridge.setClockSync(&mClock);
+    mNavBridge.setClockSync(&mClock);
+    mCmdBridge.setStats(&mStats, Stats::DIR_C2D);
+    mNavBridge.setStats(&mStats, Stats::DIR_D2C);
+    mStats.setLinkQuality(&mLink);
+    mStats.setVideoThrottle(&mVideo);
+    mCache.setClockSync(&mClock);
+    mCmdBridge.setStateCache(&mCache);
+    mNavBridge.setStateCache(&mCache);
+    mCmdBridge.setSeqSplice(&mSplice);
+    mNavBridge.setSeqSplice(&mSplice);
+    mCmdBridge.setPCMDSplice(&mPCMDSplice);
+    mControl.setClockSync(&mClock);
+    mControl.setSeqSplice(&mSplice);
+    mControl.setPCMDSplice(&mPCMDSplice);
+    mNavBridge.setAckCallback(ackCallback);
+    WiFi.onEvent(WiFiEvent);
+
+    // position, speed, attitude, altitude
+    for (u8 cmd = 4; cmd <= 8; cmd++) {
+        if (cmd != 7)
+            mDecim.addKey(PACK_CMD(PROJECT_ARDRONE3, ARDRONE3_CLASS_PILOTINGSTATE, cmd), 0);
+    }
+    mDecim.setSinkRate(SINK_LOG, LOG_REPORT_HZ);
+    for (u8 sink = SINK_LOG; sink < DEC_MAX_SINKS; sink++) {
+        if (sink == SINK_REC)
+            mDecim.setSinkRate(sink, REC_REPORT_HZ);
+        else if (sink >= SINK_SUB)
+            mDecim.setSinkRate(sink, SUB_REPORT_HZ);
+        mDecim.setCallback(sink, decimCallback);
+    }
+    mNavBridge.setDecimator(&mDecim, SINK_SUB);
+    mTelem.setLinkQuality(&mLink);
+    mTelem.setVideoThrottle(&mVideo);
+    mNavBridge.setTapCallback(tapCallback);
+    mCmdBridge.setRecorder(&mRec);
+    mCap.setClockSync(&mClock);
+    mCmdBridge.setCapture(&mCap);
+    mNavBridge.setCapture(&mCap);
+    mControl.setCapture(&mCap);
+    mRec.setClockSync(&mClock);
+    mRec.begin();
 
     WiFi.mode(WIFI_AP_STA);
     WiFi.softAP("BebopDrone-Bridge");
@@ -313,43 +673,78 @@ void setupNetwork(void)
 }
 
 void setup() {
-    Serial.begin(57600);
+#ifdef __SBUS_LINK__
+    Serial.begin(SERIAL_LINK_BAUD_SBUS, SERIAL_8E2);
+#else
+    Serial.begin(SERIAL_LINK_BAUD);
+#endif
     setupNetwork();
+
+    // soft reset while flying, the drone may still be there
+    if (mSession.load()) {
+        strncpy(mStrDiscovery2App, mSession.getDiscovery(), sizeof(mStrDiscovery2App) - 1);
+        mLostTS = millis();
+        mJoinTS = 0;
+        mNextState = STATE_RECONNECT;
+    }
 }
 
-bool app_handleDiscovery(void)
+void appJsonCallback(char *key, char *value, u8 type)
 {
-    u8      buf[256];
-    char    sv[20];
-    
-    if (mAppDiscoveryServer.hasClient()) {
-        if (!mAppDiscoveryClient || !mAppDiscoveryClient.connected()) {
-            if (mAppDiscoveryClient)
-                mAppDiscoveryClient.stop();
+    Utils::printf("app discovery %s : %s\n", key, value);
+    if (!strcmp(key, "d2c_port"))
+        mAppD2CPort = atoi(value);
+}
 
-            mAppDiscoveryClient = mAppDiscoveryServer.available();
-        }
+void app_resetDiscovery(void)
+{
+    mAppJson.reset();
+    mAppJson.setCallback(appJsonCallback);
+    mAppD2CPort = 0;
+}
+
+// one read per call, the request may come in pieces
+bool app_handleDiscovery(void)
+{
+    u8      buf[64];
+    u8      ret;
+    int     len;
+    TcpConn *conn = mAppDiscovery.getClient();
+
+    if (mAppDiscovery.hasClient())
+        app_resetDiscovery();
+
+    len = conn->read(buf, sizeof(buf));
+    if (len <= 0)
+        return false;
+
+    ret = mAppJson.feed(buf, len);
+    if (ret == JsonStream::JSON_MORE)
+        return false;
+
+    // ready for the next request on the same connection
+    mAppJson.reset();
+    if (ret == JsonStream::JSON_ERROR || mAppD2CPort == 0) {
+        Utils::printf("bad app discovery, d2c_port:%d !!\n", mAppD2CPort);
+        conn->close();
+        return false;
     }
 
-    if (mAppDiscoveryClient && mAppDiscoveryClient.connected()) {
-        mAppDiscoveryClient.read(buf, mAppDiscoveryClient.available());
-        char *ptr = strstr((char*)buf, "\"d2c_port\":");
-        if (ptr) {
-            ptr += strlen("\"d2c_port\":");
-            char *comma = strstr(ptr, ",");
-            char szPort[20];
-            
-            strncpy(szPort, ptr, comma - ptr);
-            szPort[comma - ptr] = 0;
-            int port = atoi(szPort);
-
-            mNavBridge.setDest(mAppDiscoveryClient.remoteIP(), port);
-            Utils::printf("app nav port (d2c_port):%d  %s!!\n", port, mStrDiscovery2App);
-            mAppDiscoveryClient.print(mStrDiscovery2App);
-            return true;
-        }
+    // the first app pilots and gets everything, the next ones watch
+    if (mNavBridge.getSubscriberCnt() == 0)
+        mAppSub = mNavBridge.addSubscriber(conn->remoteIP(), mAppD2CPort);
+    else
+        mAppSub = mNavBridge.addSubscriber(conn->remoteIP(), mAppD2CPort, SUB_FILTER, SUB_RATE);
+    mCmdBridge.setSource(mNavBridge.getHostIP());
+    Utils::printf("app nav port (d2c_port):%d  %s!!\n", mAppD2CPort, mStrDiscovery2App);
+    if (!conn->write(mStrDiscovery2App)) {
+        Utils::printf("app discovery answer not sent !!\n");
+        conn->close();
+        return false;
     }
-    return false;
+    mAppLinked = true;
+    mAppD2CPort = 0;
+    return true;
 }
 
 void loop()
@@ -358,31 +753,63 @@ void loop()
 
     switch (mNextState) {
         case STATE_INIT:
-            if (bebop_scanAndConnect())
+            if (bebop_scanAndConnect()) {
+                mJoinTS = millis();
                 mNextState = STATE_AP_CONNECT;
+            }
+            break;
+
+        case STATE_AP_CONNECT:
+            // the disconnect event leaves failed joins to this timeout
+            if (millis() - mJoinTS > AP_CONNECT_TIMEOUT_MS) {
+                Utils::printf("Join failed, scan again\n");
+                WiFi.disconnect();
+                mJoinTS = 0;
+                mNextState = STATE_INIT;
+                mSerial.sendCmd(SerialProtocol::CMD_SET_STATE, &mNextState, 1);
+            }
+            if (mAppLinked)
+                mCmdBridge.process(dataAck);
             break;
 
         case STATE_DISCOVERY:
             if (bebop_connectDiscovery()) {
                 mNextState = STATE_DISCOVERY_ACK;
             }
+            if (mAppLinked)
+                mCmdBridge.process(dataAck);
             break;
 
         case STATE_DISCOVERY_ACK:
+            if (mAppLinked)
+                mCmdBridge.process(dataAck);
             if (bebop_handleDiscovery()) {
-                mAppDiscoveryServer.begin();
-
-                mNavBridge.begin();
+                if (mAppLinked) {
+                    // new drone session under a running app, the old states are gone
+                    mNavBridge.resetSeq();
+                    mCmdBridge.resetSeq();
+                    mCache.reset();
+                    mSplice.reset();
+                    mPCMDSplice.reset();
+                    mTelem.reset();
+                    bebop_reconnected(false);
+                } else {
+                    mAppDiscovery.begin();
+                    mNavBridge.begin();
+                    mCmdBridge.begin();
+                    mStats.begin();
+                    mCap.begin();
+                }
                 mNavBridge.setBypass(false);
-                mCmdBridge.begin();
                 mCmdBridge.setBypass(false);
-                
+                mControl.resetConfig();
+
                 mNextState = STATE_CONFIG;
             }
             break;
 
         case STATE_CONFIG:
-            if (app_handleDiscovery()) {
+            if (app_handleDiscovery() || (mAppLinked && mControl.isConfigDone())) {
                 mCmdBridge.setBypass(true);
                 mNavBridge.setBypass(true);
                 mNextState = STATE_WORK;
@@ -392,13 +819,62 @@ void loop()
             if (size > 0) {
                 mCmdBridge.sendto(dataAck, size);
             }
+            mControl.config();
             mCmdBridge.kick();
             
             break;
 
+        case STATE_RECONNECT:
+            if (mJoinTS == 0) {
+                bebop_directJoin();
+                mJoinTS = millis();
+            } else if (millis() - mJoinTS > RECONNECT_TIMEOUT_MS) {
+                Utils::printf("Reconnect failed, full scan\n");
+                WiFi.disconnect();
+                WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0));
+                mNextState = STATE_INIT;
+                mSerial.sendCmd(SerialProtocol::CMD_SET_STATE, &mNextState, 1);
+            }
+            // keep the app socket drained, stale sticks are worse than none
+            if (mAppLinked)
+                mCmdBridge.process(dataAck);
+            break;
+
+        case STATE_RESUME:
+            if (!mAppLinked) {
+                mNextState = STATE_DISCOVERY;
+                break;
+            }
+            mCmdBridge.process(dataAck);
+            mNavBridge.process(dataAck);
+            mCmdBridge.kick();      // our pings make the drone talk
+
+            if ((s32)(mNavBridge.getLastRxTS() - mResumeTS) >= 0) {
+                bebop_reconnected(true);
+                mNextState = STATE_WORK;
+                mSerial.sendCmd(SerialProtocol::CMD_SET_STATE, &mNextState, 1);
+            } else if (millis() - mResumeTS > RESUME_TIMEOUT_MS) {
+                Utils::printf("Session gone, discovery again\n");
+                mNextState = STATE_DISCOVERY;
+            }
+            break;
+
         case STATE_WORK:
+            // the app came back, the cache answers its AllStates / AllSettings
+            if (app_handleDiscovery() && mAppSub == 0) {
+                // a new pilot process starts its seq over, old ones would look stale
+                mCmdBridge.resetSeq();
+                mSplice.restart();
+                mPCMDSplice.restart();
+                Utils::printf("app reconnected\n");
+            }
+
             mCmdBridge.process(dataAck);
             mNavBridge.process(dataAck);
+            // steps left when the app came in early, the drone acks come back through the bridge
+            if (mControl.getConfigTime() == 0)
+                mControl.config();
+            mCmdBridge.kick();
             break;
 
 #if 0
@@ -419,6 +895,13 @@ void loop()
             break;
 #endif            
     }
+    if (mNextState >= STATE_CONFIG) {
+        mStats.process();
+        mCap.process();
+        mDecim.poll();
+    }
     mSerial.handleRX();
+    sendTelemetry();
+    recordFlight();
 }
 
@@ -0,0 +1,78 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <string.h>
+#include "RCCurve.h"
+#include "Utils.h"
+
+#define DEFAULT_DEADBAND    5
+
+RCCurve::RCCurve()
+{
+    CURVE_T curve;
+
+    memset(&curve, 0, sizeof(curve));
+    curve.rate     = 100;
+    curve.deadband = DEFAULT_DEADBAND;
+
+    for (u8 ch = 0; ch < MAX_CH; ch++)
+        setCurve(ch, &curve);
+}
+
+void RCCurve::setCurve(u8 ch, CURVE_T *curve)
+{
+    if (ch >= MAX_CH)
+        return;
+
+    mCurve[ch] = *curve;
+    mCurve[ch].expo     = constrain(curve->expo, -50, 100);      // below -50 the curve is not monotonic
+    mCurve[ch].rate     = min(curve->rate, (u8)100);
+    mCurve[ch].deadband = min(curve->deadband, (u8)50);
+    mCurve[ch].trim     = constrain(curve->trim, -50, 50);
+    build(ch);
+}
+
+void RCCurve::getCurve(u8 ch, CURVE_T *curve)
+{
+    if (ch < MAX_CH)
+        *curve = mCurve[ch];
+}
+
+// float is fine here, tables are only rebuilt on configuration changes
+void RCCurve::build(u8 ch)
+{
+    CURVE_T *c = &mCurve[ch];
+    float   e  = c->expo / 100.0f;
+    float   x;
+    float   y;
+    int     v;
+
+    for (int i = 0; i < LUT_LEN; i++) {
+        v = i - 100;
+        if (c->reverse)
+            v = -v;
+
+        if (abs(v) <= c->deadband) {
+            x = 0;
+        } else {
+            x = (float)(abs(v) - c->deadband) / (100 - c->deadband);
+            if (v < 0)
+                x = -x;
+        }
+
+        y = (1.0f - e) * x + e * x * x * x;
+        v = lroundf(y * c->rate) + c->trim;
+        mLUT[ch][i] = constrain(v, -100, 100);
+    }
+}
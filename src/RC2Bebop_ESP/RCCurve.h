@@ -0,0 +1,57 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _RC_CURVE_H_
+#define _RC_CURVE_H_
+
+#include <Arduino.h>
+#include "Common.h"
+
+// stick curve of a channel, applied in this order : reverse, deadband, expo, rate, trim
+typedef struct {
+    s8  expo;           // -50 ~ 100 %, positive softens the center
+    u8  rate;           // 0 ~ 100 % of full throw
+    u8  deadband;       // 0 ~ 50, remaining travel is stretched to full range
+    s8  trim;           // -50 ~ 50
+    u8  reverse;
+} CURVE_T;
+
+class RCCurve
+{
+public:
+    enum {
+        MAX_CH  = 8,
+        LUT_LEN = 201,  // -100 ~ 100
+    };
+
+    RCCurve();
+
+    void setCurve(u8 ch, CURVE_T *curve);
+    void getCurve(u8 ch, CURVE_T *curve);
+
+    inline s8 apply(u8 ch, s16 v)
+    {
+        if (ch >= MAX_CH)
+            return 0;
+        v = constrain(v, -100, 100);
+        return mLUT[ch][v + 100];
+    }
+
+private:
+    void build(u8 ch);
+
+    CURVE_T mCurve[MAX_CH];
+    s8      mLUT[MAX_CH][LUT_LEN];
+};
+
+#endif
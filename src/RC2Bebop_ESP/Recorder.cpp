@@ -0,0 +1,413 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include "Recorder.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include "ClockSync.h"
+#include "Utils.h"
+#define REC_LOG(...)    Utils::printf(__VA_ARGS__)
+#else
+// host build writes to a plain file
+#include <time.h>
+#define REC_LOG(...)    fprintf(stderr, __VA_ARGS__)
+#endif
+
+static int put16(u8 *buf, u16 v)
+{
+    buf[0] = v & 0xff;
+    buf[1] = (v >> 8) & 0xff;
+    return 2;
+}
+
+static int put32(u8 *buf, u32 v)
+{
+    buf[0] = v & 0xff;
+    buf[1] = (v >>  8) & 0xff;
+    buf[2] = (v >> 16) & 0xff;
+    buf[3] = (v >> 24) & 0xff;
+    return 4;
+}
+
+Recorder::Recorder()
+{
+#ifndef ARDUINO
+    mFile = NULL;
+#endif
+    mOpen     = false;
+    mHead     = 0;
+    mTail     = 0;
+    mOffset   = 0;
+    mIndexOfs = 0;
+    mRecords  = 0;
+    mDrops    = 0;
+    mIndexTS  = 0;
+    mSyncTS   = 0;
+    mPendingTS = 0;
+    mCut      = REC_NO_CUT;
+    mClock    = NULL;
+}
+
+Recorder::~Recorder()
+{
+    close();
+}
+
+/*
+*****************************************************************************************
+* platform
+*****************************************************************************************
+*/
+#ifdef ARDUINO
+u32 Recorder::now(void)
+{
+    return millis();
+}
+
+u32 Recorder::getWallClock(void)
+{
+    return mClock ? mClock->getEpoch() : 0;
+}
+
+// file count, lowest and highest number in REC_DIR
+static u8 scanDir(u32 *first, u32 *last)
+{
+    Dir dir = LittleFS.openDir(REC_DIR);
+    u8  cnt = 0;
+
+    *first = 0xffffffff;
+    *last  = 0;
+    while (dir.next()) {
+        u32 no = atoi(dir.fileName().c_str());
+
+        *first = min(*first, no);
+        *last  = max(*last, no);
+        cnt++;
+    }
+    return cnt;
+}
+
+// REC_DIR/nnnnn.bin after the last one, the oldest go while there are too many or a full file
+// would not fit. numbers may have gaps, the directory is read again after each removal
+bool Recorder::nextPath(char *path)
+{
+    FSInfo  info;
+    u32     first;
+    u32     last;
+    u8      cnt;
+
+    if (!LittleFS.begin()) {
+        REC_LOG("REC : no file system\n");
+        return false;
+    }
+    LittleFS.mkdir(REC_DIR);
+
+    while ((cnt = scanDir(&first, &last)) > 0) {
+        LittleFS.info(info);
+        if (cnt < REC_MAX_FILES && info.totalBytes - info.usedBytes >= REC_MAX_FILE_LEN + REC_MIN_FREE)
+            break;
+
+        sprintf(path, REC_DIR "/%05u.bin", first);
+        if (!LittleFS.remove(path))
+            break;
+        REC_LOG("REC : removed %s\n", path);
+    }
+
+    sprintf(path, REC_DIR "/%05u.bin", last + 1);
+    return true;
+}
+
+bool Recorder::openFile(const char *path)
+{
+    mFile = LittleFS.open(path, "w");
+    return (bool)mFile;
+}
+
+bool Recorder::writeFile(u8 *data, u16 size)
+{
+    return mFile.write(data, size) == size;
+}
+
+void Recorder::syncFile(void)
+{
+    mFile.flush();
+}
+
+void Recorder::closeFile(void)
+{
+    mFile.close();
+}
+
+#else
+u32 Recorder::now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+u32 Recorder::getWallClock(void)
+{
+    return time(NULL);
+}
+
+bool Recorder::nextPath(char *path)
+{
+    static u32 no = 0;
+
+    sprintf(path, "fdr%05u.bin", ++no);
+    return true;
+}
+
+bool Recorder::openFile(const char *path)
+{
+    mFile = fopen(path, "wb");
+    return mFile != NULL;
+}
+
+bool Recorder::writeFile(u8 *data, u16 size)
+{
+    return fwrite(data, 1, size, mFile) == size;
+}
+
+void Recorder::syncFile(void)
+{
+    fflush(mFile);
+}
+
+void Recorder::closeFile(void)
+{
+    fclose(mFile);
+    mFile = NULL;
+}
+#endif
+
+/*
+*****************************************************************************************
+* records
+*****************************************************************************************
+*/
+void Recorder::close(void)
+{
+    if (mOpen) {
+        while (mHead != mTail && mOpen)
+            poll();
+        if (mOpen)
+            closeFile();
+    }
+    mOpen = false;
+}
+
+// the header goes straight to the file, the ring only carries records
+bool Recorder::startFile(const char *path)
+{
+    u8  hdr[REC_FILE_HDR_LEN];
+
+    if (!openFile(path)) {
+        REC_LOG("REC : can't open %s\n", path);
+        return false;
+    }
+
+    memset(hdr, 0, sizeof(hdr));
+    put32(&hdr[0], REC_MAGIC);
+    hdr[4] = REC_VERSION;
+    hdr[5] = REC_FILE_HDR_LEN;
+    put32(&hdr[8], getWallClock());
+    if (!writeFile(hdr, sizeof(hdr))) {
+        REC_LOG("REC : can't write %s\n", path);
+        closeFile();
+        return false;
+    }
+    REC_LOG("REC : %s\n", path);
+
+    return true;
+}
+
+bool Recorder::begin(const char *path)
+{
+    char    name[32];
+
+    close();
+    if (!path) {
+        if (!nextPath(name))
+            return false;
+        path = name;
+    }
+
+    if (!startFile(path))
+        return false;
+
+    mHead     = 0;
+    mTail     = 0;
+    mCut      = REC_NO_CUT;
+    mOffset   = REC_FILE_HDR_LEN;
+    mIndexOfs = 0;
+    mRecords  = 0;
+    mDrops    = 0;
+    mOpen     = true;
+    mIndexTS  = now();
+    mSyncTS   = mIndexTS;
+
+    return true;
+}
+
+// everything up to the cut is written, the rest of the ring belongs to the next file
+void Recorder::rotate(void)
+{
+    char    name[32];
+
+    closeFile();
+    mCut = REC_NO_CUT;
+    if (!nextPath(name) || !startFile(name)) {
+        REC_LOG("REC : no next file, stopped\n");
+        mOpen = false;
+        return;
+    }
+    mSyncTS = now();
+}
+
+// on a record boundary, offsets and counts start over for the next file
+void Recorder::checkCut(void)
+{
+    if (mOffset < REC_MAX_FILE_LEN || mCut != REC_NO_CUT)
+        return;
+
+    mCut      = mHead;
+    mOffset   = REC_FILE_HDR_LEN;
+    mIndexOfs = 0;
+    mRecords  = 0;
+    mDrops    = 0;
+}
+
+// caller checked the room
+void Recorder::put(u8 *data, u16 size)
+{
+    if (mHead == mTail)
+        mPendingTS = now();
+
+    for (u16 i = 0; i < size; i++) {
+        mBuf[mHead] = data[i];
+        mHead = (mHead + 1) & (REC_BUF_LEN - 1);
+    }
+}
+
+void Recorder::add(u8 type, u8 *data, u8 size)
+{
+    u8  hdr[REC_HDR_LEN];
+
+    if (!mOpen)
+        return;
+
+    if (getFree() < REC_HDR_LEN + size) {
+        mDrops++;
+        return;
+    }
+    checkCut();
+
+    hdr[0] = type;
+    hdr[1] = size;
+    put32(&hdr[2], now());
+    put(hdr, REC_HDR_LEN);
+    put(data, size);
+    mOffset += REC_HDR_LEN + size;
+    mRecords++;
+}
+
+void Recorder::addRC(s16 *rc, u8 cnt, u8 status)
+{
+    u8  buf[8 * 2 + 1];
+    int idx = 0;
+
+    for (u8 i = 0; i < 8; i++)
+        idx += put16(&buf[idx], (i < cnt) ? rc[i] : 0);
+    buf[idx++] = status;
+    add(REC_RC, buf, idx);
+}
+
+void Recorder::addPCMD(u8 src, u8 flag, s8 roll, s8 pitch, s8 yaw, s8 gaz)
+{
+    u8  buf[6] = { src, flag, (u8)roll, (u8)pitch, (u8)yaw, (u8)gaz };
+
+    add(REC_PCMD, buf, sizeof(buf));
+}
+
+// lets a reader find its way back after a torn record
+void Recorder::addIndex(u32 ts)
+{
+    u8  buf[REC_INDEX_LEN];
+    u32 ofs;
+
+    // an index that starts the next file points into that one
+    checkCut();
+    ofs = mOffset;
+
+    put32(&buf[0],  REC_INDEX_MAGIC);
+    put32(&buf[4],  ofs);
+    put32(&buf[8],  mIndexOfs);
+    put32(&buf[12], mRecords);
+    put32(&buf[16], mDrops);
+    put32(&buf[20], getWallClock());
+    add(REC_INDEX, buf, sizeof(buf));
+
+    if (mOffset != ofs)
+        mIndexOfs = ofs;
+    mIndexTS = ts;
+}
+
+void Recorder::poll(void)
+{
+    u32 ts = now();
+    u16 used;
+    u16 len;
+
+    if (!mOpen)
+        return;
+
+    if (ts - mIndexTS >= REC_INDEX_MS)
+        addIndex(ts);
+
+    if (mCut == mTail) {
+        rotate();
+        if (!mOpen)
+            return;
+    }
+
+    // the file being cut is written out without waiting
+    used = (((mCut != REC_NO_CUT) ? mCut : mHead) - mTail) & (REC_BUF_LEN - 1);
+    if (used == 0)
+        return;
+    if (used < REC_CHUNK_LEN && ts - mPendingTS < REC_FLUSH_MS && mCut == REC_NO_CUT)
+        return;
+
+    // one contiguous chunk at most
+    len = (used < REC_CHUNK_LEN) ? used : REC_CHUNK_LEN;
+    if (len > REC_BUF_LEN - mTail)
+        len = REC_BUF_LEN - mTail;
+    if (!writeFile(&mBuf[mTail], len)) {
+        REC_LOG("REC : write failed, stopped\n");
+        closeFile();
+        mOpen = false;
+        return;
+    }
+    mTail = (mTail + len) & (REC_BUF_LEN - 1);
+    mPendingTS = ts;
+
+    if (ts - mSyncTS >= REC_SYNC_MS) {
+        syncFile();
+        mSyncTS = ts;
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+
+#include "common.h"
+
+#ifdef ARDUINO
+#include <LittleFS.h>
+#else
+#include <stdio.h>
+#endif
+
+// flight data recorder, little endian
+//  file   : magic(4) "RBFR", version, header len, reserved(2), wall clock at open(4, 0 unknown), reserved(4)
+//  record : type, payload len, local ms(4), payload
+//  index  : every REC_INDEX_MS, magic(4) "RIDX", own offset(4), previous index offset(4),
+//           records(4), dropped records(4), wall clock(4)
+#define REC_MAGIC           0x52464252
+#define REC_INDEX_MAGIC     0x58444952
+#define REC_VERSION         1
+#define REC_FILE_HDR_LEN    16
+#define REC_HDR_LEN         6
+#define REC_INDEX_LEN       24
+
+#define REC_BUF_LEN         2048    // power of 2
+#define REC_CHUNK_LEN       256     // most written to flash per poll()
+#define REC_FLUSH_MS        2000    // write a short chunk when it got that old
+#define REC_SYNC_MS         10000   // file system commit
+#define REC_INDEX_MS        1000
+#define REC_DIR             "/fdr"
+#define REC_MAX_FILES       8
+#define REC_MAX_FILE_LEN    (256 * 1024)    // then the next file, the oldest may go
+#define REC_MIN_FREE        (64 * 1024)     // on top of a full file
+#define REC_NO_CUT          0xffff
+
+class ClockSync;
+
+// records go to a ram ring and never wait, what does not fit is dropped and counted.
+// poll() writes at most one chunk, so the flash cost per loop is bounded.
+class Recorder
+{
+public:
+    enum {
+        REC_STATE = 1,          // esp state
+        REC_RC,                 // channels s16 x 8, status
+        REC_PCMD,               // source, flag, roll, pitch, yaw, gaz
+        REC_TELEMETRY,          // Telemetry payload
+        REC_LINK,               // rtt us(4), jitter us(4), loss(2), rssi(2), quality
+        REC_REPORT,             // ARCommand : prj, cls, cmd(2), args
+        REC_INDEX = 0x7f,
+    };
+
+    enum {
+        PCMD_RC = 0,            // built by the bridge from the sticks
+        PCMD_APP,               // app PCMD, after the mixer
+        PCMD_FAILSAFE,
+    };
+
+    Recorder();
+    ~Recorder();
+
+    bool begin(const char *path = NULL);    // NULL : next file in REC_DIR
+    void close(void);
+    bool isOpen(void)                       { return mOpen; }
+    void setClockSync(ClockSync *clock)     { mClock = clock; }
+
+    void add(u8 type, u8 *data, u8 size);
+    void addRC(s16 *rc, u8 cnt, u8 status);
+    void addPCMD(u8 src, u8 flag, s8 roll, s8 pitch, s8 yaw, s8 gaz);
+    void poll(void);
+
+    u32  getRecords(void)                   { return mRecords; }
+    u32  getDrops(void)                     { return mDrops;   }
+
+private:
+#ifdef ARDUINO
+    File    mFile;
+#else
+    FILE    *mFile;
+#endif
+    bool    mOpen;
+    u8      mBuf[REC_BUF_LEN];
+    u16     mHead;
+    u16     mTail;
+    u32     mOffset;            // file offset of the next record
+    u32     mIndexOfs;
+    u32     mRecords;
+    u32     mDrops;
+    u32     mIndexTS;
+    u32     mSyncTS;
+    u32     mPendingTS;         // oldest byte not written yet
+    u16     mCut;               // ring position where the next file starts
+    ClockSync *mClock;
+
+    u16  getFree(void)          { return REC_BUF_LEN - 1 - ((mHead - mTail) & (REC_BUF_LEN - 1)); }
+    void put(u8 *data, u16 size);
+    void checkCut(void);
+    void addIndex(u32 ts);
+    u32  getWallClock(void);
+    bool startFile(const char *path);
+    void rotate(void);
+    bool openFile(const char *path);
+    bool writeFile(u8 *data, u16 size);
+    void syncFile(void);
+    void closeFile(void);
+    bool nextPath(char *path);
+    static u32 now(void);
+};
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+#include "SeqSplice.h"
+#include "Bebop.h"
+
+SeqSplice::SeqSplice(u8 id)
+{
+    mID = id;
+    reset();
+}
+
+void SeqSplice::reset(void)
+{
+    mValid    = false;
+    mStamped  = false;
+    mShift    = 0;
+    mLast     = 0;
+    mAppSeq   = 0;
+    mDroneSeq = 0;
+    memset(mOwn, 0, sizeof(mOwn));
+}
+
+void SeqSplice::restart(void)
+{
+    mValid   = false;
+    mStamped = true;
+}
+
+u8 SeqSplice::onAppFrame(u8 seq)
+{
+    // a retransmit keeps the seq the drone already acked or is about to
+    if (mValid && seq == mAppSeq)
+        return mDroneSeq;
+
+    if (!mValid && mStamped)
+        mShift = mLast + 1 - seq;
+
+    mValid    = true;
+    mAppSeq   = seq;
+    mDroneSeq = seq + mShift;
+    mLast     = mDroneSeq;
+    mOwn[mDroneSeq >> 3] &= ~(1 << (mDroneSeq & 0x07));
+    return mDroneSeq;
+}
+
+u8 SeqSplice::onDroneAck(u8 seq)
+{
+    if (mValid && seq == mDroneSeq)
+        return mAppSeq;
+    return seq - mShift;
+}
+
+void SeqSplice::stamp(u8 *frame)
+{
+    u8 seq = ++mLast;
+
+    frame[2] = seq;
+    mShift++;
+    mStamped = true;
+    if (frame[0] == FRAME_TYPE_DATA_WITH_ACK)
+        mOwn[seq >> 3] |= (1 << (seq & 0x07));
+    else
+        mOwn[seq >> 3] &= ~(1 << (seq & 0x07));
+}
+
+bool SeqSplice::isOwnAck(u8 seq)
+{
+    u8 bit = 1 << (seq & 0x07);
+
+    if (!(mOwn[seq >> 3] & bit))
+        return false;
+    mOwn[seq >> 3] &= ~bit;
+    return true;
+}
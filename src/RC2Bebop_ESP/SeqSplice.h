@@ -0,0 +1,47 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SEQ_SPLICE_H_
+#define _SEQ_SPLICE_H_
+
+#include "Common.h"
+
+// our own frames on a buffer the app also writes in bypass. they take the seq
+// right after the last app frame, later app frames move up by the number of
+// frames spliced in and the drone acks of them move back down. frames sent
+// before the app start the buffer, its first frame goes after them
+class SeqSplice
+{
+public:
+    SeqSplice(u8 id);
+
+    void reset(void);
+    void restart(void);         // the app starts its seq over, its next frame goes after the last one
+    u8   getID(void)            { return mID; }
+    u8   onAppFrame(u8 seq);    // seq towards the drone
+    u8   onDroneAck(u8 seq);    // seq towards the app
+    void stamp(u8 *frame);
+    bool isOwnAck(u8 seq);      // drone ack of one of our ack required frames
+
+private:
+    u8      mID;
+    bool    mValid;
+    bool    mStamped;           // our frames went out before the app ones
+    u8      mShift;
+    u8      mLast;              // last seq the drone got on the buffer
+    u8      mAppSeq;            // last app frame as the app sent it
+    u8      mDroneSeq;          // and as the drone got it
+    u8      mOwn[32];           // drone seqs of our frames waiting for an ack
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <string.h>
+#include "SeqTracker.h"
+
+SeqTracker::SeqTracker()
+{
+    reset();
+}
+
+void SeqTracker::reset(void)
+{
+    memset(mSeen, 0, sizeof(mSeen));
+    mGap = 0;
+}
+
+u8 SeqTracker::check(u8 id, u8 seq)
+{
+    u8 diff;
+
+    mGap = 0;
+    if (!(mSeen[id >> 5] & (1UL << (id & 0x1f)))) {
+        mSeen[id >> 5] |= (1UL << (id & 0x1f));
+        mLast[id]   = seq;
+        mWindow[id] = 1;
+        return SEQ_NEW;
+    }
+
+    diff = seq - mLast[id];
+    if (diff == 0)
+        return SEQ_DUP;
+
+    if (diff < 128) {
+        mWindow[id] = (diff < SEQ_WINDOW) ? (mWindow[id] << diff) | 1 : 1;
+        mLast[id]   = seq;
+        mGap        = diff - 1;
+        return mGap ? SEQ_GAP : SEQ_IN_ORDER;
+    }
+
+    // behind
+    diff = mLast[id] - seq;
+    if (diff >= SEQ_RESYNC) {
+        mLast[id]   = seq;
+        mWindow[id] = 1;
+        return SEQ_NEW;
+    }
+    if (diff >= SEQ_WINDOW)
+        return SEQ_STALE;
+    if (mWindow[id] & (1UL << diff))
+        return SEQ_DUP;
+
+    mWindow[id] |= (1UL << diff);
+    return SEQ_LATE;
+}
@@ -0,0 +1,48 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SEQ_TRACKER_H_
+#define _SEQ_TRACKER_H_
+
+#include "Common.h"
+
+#define SEQ_WINDOW          32      // late frames within this distance are still recognized
+#define SEQ_RESYNC          64      // further behind, the peer has restarted its counter
+
+// receive side sequence check per ARNetwork buffer id
+class SeqTracker
+{
+public:
+    enum {
+        SEQ_NEW = 0,        // first frame or resync
+        SEQ_IN_ORDER,
+        SEQ_GAP,            // ahead, getGap() frames missing
+        SEQ_LATE,           // behind but not seen before, reordered
+        SEQ_DUP,            // seen before, retransmit
+        SEQ_STALE,          // behind past the window, can't tell, taken as a retransmit
+    };
+
+    SeqTracker();
+
+    void reset(void);
+    u8   check(u8 id, u8 seq);
+    u8   getGap(void)       { return mGap; }
+
+private:
+    u8      mLast[256];
+    u32     mWindow[256];   // bit n set : mLast - n was received
+    u32     mSeen[8];       // ids with a valid mLast
+    u8      mGap;
+};
+
+#endif
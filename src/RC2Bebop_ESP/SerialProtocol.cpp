@@ -15,10 +15,13 @@
 #include "utils.h"
 
 
+// nobody listens on an SBUS link, the AVR RX is the receiver's
 void SerialProtocol::putChar2TX(u8 data)
 {
+#ifndef __SBUS_LINK__
     chkSumTX ^= data;
-//    Serial.write(data);
+    Serial.write(data);
+#endif
 }
 
 SerialProtocol::SerialProtocol()
@@ -50,7 +53,6 @@ void SerialProtocol::sendResponse(bool ok, u8 cmd, u8 *data, u8 size)
 
 void SerialProtocol::sendCmd(u8 cmd, u8 *data, u8 size)
 {
-#if 0    
     putChar2TX('$');
     putChar2TX('M');
     putChar2TX('<');
@@ -60,7 +62,6 @@ void SerialProtocol::sendCmd(u8 cmd, u8 *data, u8 size)
     for (u8 i = 0; i < size; i++)
         putChar2TX(*data++);
     putChar2TX(chkSumTX);
-#endif
 }
 
 void SerialProtocol::evalCommand(u8 cmd, u8 *data, u8 size)
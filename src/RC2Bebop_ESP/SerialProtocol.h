@@ -19,7 +19,17 @@
 #include "utils.h"
 #include <stdarg.h>
 
-#define MAX_PACKET_SIZE 32
+#define MAX_PACKET_SIZE 40
+
+#define SERIAL_LINK_BAUD        57600
+#define SERIAL_LINK_BAUD_SBUS   100000      // 8E2, AVR USART RX is taken by the SBUS receiver
+
+// here rather than in the sketch so SerialProtocol.cpp sees it too
+//#define __SBUS_LINK__
+
+// status byte after the channels of CMD_SET_RC
+#define RC_STATUS_FRAME_LOST    0x01
+#define RC_STATUS_FAILSAFE      0x02
 
 class SerialProtocol
 {
@@ -30,6 +40,9 @@ public:
         CMD_SET_RC,
         CMD_SET_STATE,
         CMD_GET_FREE_RAM,
+        CMD_SET_RCVR,
+        CMD_SET_CURVE,
+        CMD_SET_TELEMETRY,
         CMD_TEST = 110,
     } CMD_T;
 
@@ -41,6 +54,7 @@ public:
     void sendResponse(bool ok, u8 cmd, u8 *data, u8 size);
     void evalCommand(u8 cmd, u8 *data, u8 size);
     void setCallback(u32 (*callback)(u8 cmd, u8 *data, u8 size));
+    bool isIdle(void)   { return mState == STATE_IDLE; }    // not inside an inbound frame
 
 private:
     typedef enum
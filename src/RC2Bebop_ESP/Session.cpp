@@ -0,0 +1,77 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <string.h>
+#include "Session.h"
+#include "Utils.h"
+
+extern "C" {
+#include "user_interface.h"
+}
+
+Session::Session()
+{
+    memset(&mData, 0, sizeof(mData));
+}
+
+// over the whole block with the sum itself as 0
+u16 Session::checksum(void)
+{
+    u8  *p = (u8*)&mData;
+    u16 saved = mData.sum;
+    u16 sum = 0;
+
+    mData.sum = 0;
+    for (u16 i = 0; i < sizeof(mData); i++)
+        sum = ((sum << 1) | (sum >> 15)) + p[i];
+    mData.sum = saved;
+
+    return sum;
+}
+
+// called once the drone discovery is done
+void Session::save(u16 c2dPort, char *discovery)
+{
+    memset(&mData, 0, sizeof(mData));
+    strncpy(mData.ssid, WiFi.SSID().c_str(), sizeof(mData.ssid) - 1);
+    memcpy(mData.bssid, WiFi.BSSID(), sizeof(mData.bssid));
+    mData.channel = WiFi.channel();
+    mData.ip      = WiFi.localIP();
+    mData.gateway = WiFi.gatewayIP();
+    mData.subnet  = WiFi.subnetMask();
+    mData.c2dPort = c2dPort;
+    strncpy(mData.discovery, discovery, sizeof(mData.discovery) - 1);
+    mData.magic   = SESSION_MAGIC;
+    mData.sum     = checksum();
+
+    system_rtc_mem_write(SESSION_RTC_BLOCK, &mData, sizeof(mData));
+    Utils::printf("SESSION saved : %s ch:%d %s\n", mData.ssid, mData.channel, getIP().toString().c_str());
+}
+
+bool Session::load(void)
+{
+    system_rtc_mem_read(SESSION_RTC_BLOCK, &mData, sizeof(mData));
+    if (mData.magic != SESSION_MAGIC || mData.sum != checksum()) {
+        memset(&mData, 0, sizeof(mData));
+        return false;
+    }
+    Utils::printf("SESSION loaded : %s ch:%d\n", mData.ssid, mData.channel);
+    return true;
+}
+
+void Session::clear(void)
+{
+    memset(&mData, 0, sizeof(mData));
+    system_rtc_mem_write(SESSION_RTC_BLOCK, &mData, sizeof(mData));
+}
@@ -0,0 +1,64 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SESSION_H_
+#define _SESSION_H_
+
+#include <ESP8266WiFi.h>
+#include "Common.h"
+
+#define SESSION_MAGIC       0x42425353  // "SSBB"
+#define SESSION_RTC_BLOCK   64          // rtc user memory, survives a soft reset
+#define SESSION_DISCOVERY_LEN   256
+
+// what it took to join the drone last time, to skip the scan and the discovery
+class Session
+{
+public:
+    Session();
+
+    void save(u16 c2dPort, char *discovery);
+    bool load(void);
+    void clear(void);
+    bool isValid(void)                  { return mData.magic == SESSION_MAGIC; }
+
+    char      *getSSID(void)            { return mData.ssid;        }
+    u8        *getBSSID(void)           { return mData.bssid;       }
+    s32       getChannel(void)          { return mData.channel;     }
+    IPAddress getIP(void)               { return IPAddress(mData.ip);       }
+    IPAddress getGateway(void)          { return IPAddress(mData.gateway);  }
+    IPAddress getSubnet(void)           { return IPAddress(mData.subnet);   }
+    u16       getC2DPort(void)          { return mData.c2dPort;     }
+    char      *getDiscovery(void)       { return mData.discovery;   }
+
+private:
+    typedef struct {
+        u32  magic;
+        char ssid[33];
+        u8   bssid[6];
+        u8   pad;
+        s32  channel;
+        u32  ip;
+        u32  gateway;
+        u32  subnet;
+        u16  c2dPort;
+        u16  sum;
+        char discovery[SESSION_DISCOVERY_LEN];  // our answer to the app discovery
+    } SESSION_T;
+
+    SESSION_T   mData;
+
+    u16  checksum(void);
+};
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <string.h>
+#include "StateCache.h"
+#include "Utils.h"
+#include "Bebop.h"
+#include "NavServer.h"
+
+#define ENTRY_END           0x80    // AllStatesChanged / AllSettingsChanged, replayed last
+#define ENTRY_FREE          0x7f
+
+StateCache::StateCache()
+{
+    mClock = NULL;
+    reset();
+}
+
+// the drone session is gone, so is everything it told us
+void StateCache::reset(void)
+{
+    mArenaLen   = 0;
+    mEntryCnt   = 0;
+    mRecording  = SET_NONE;
+    mSeqShift   = 0;
+    mLastAppSeq = 0;
+    mAppIP      = 0;
+    mAckPending = false;
+    mReplaying  = false;
+    mReplayCnt  = 0;
+    for (u8 i = 0; i < SET_MAX; i++) {
+        mComplete[i] = false;
+        mOverflow[i] = false;
+    }
+}
+
+u32 StateCache::now(void)
+{
+    return mClock ? mClock->getDroneMs() : millis();
+}
+
+// states sent once per item, the first argument tells the items apart
+static const u32 TBL_LIST_CMDS[] = {
+    PACK_CMD(PROJECT_COMMON,   COMMON_CLASS_COMMONSTATE, 2),            // MassStorageStateListChanged
+    PACK_CMD(PROJECT_COMMON,   COMMON_CLASS_COMMONSTATE, 3),            // MassStorageInfoStateListChanged
+    PACK_CMD(PROJECT_COMMON,   COMMON_CLASS_COMMONSTATE, 8),            // SensorsStatesListChanged
+    PACK_CMD(PROJECT_COMMON,   COMMON_CLASS_COMMONSTATE, 11),           // DeprecatedMassStorageContentChanged
+    PACK_CMD(PROJECT_COMMON,   COMMON_CLASS_COMMONSTATE, 12),           // MassStorageContent
+    PACK_CMD(PROJECT_COMMON,   COMMON_CLASS_COMMONSTATE, 13),           // MassStorageContentForCurrentRun
+    PACK_CMD(PROJECT_COMMON,   COMMON_CLASS_FLIGHTPLANSTATE, 1),        // ComponentStateListChanged
+    PACK_CMD(PROJECT_COMMON,   COMMON_CLASS_ANIMATIONSSTATE, 0),        // List
+    PACK_CMD(PROJECT_COMMON,   COMMON_CLASS_ACCESSORYSTATE, 0),         // SupportedAccessoriesListChanged
+    PACK_CMD(PROJECT_ARDRONE3, ARDRONE3_CLASS_NETWORKSTATE, 0),         // WifiScanListChanged
+    PACK_CMD(PROJECT_ARDRONE3, ARDRONE3_CLASS_NETWORKSTATE, 2),         // WifiAuthChannelListChanged
+};
+
+// prj, cls, cmd, the first argument byte for list items only. a plain state keeps
+// its key when the value changes
+u32 StateCache::makeKey(u8 *data, u32 size)
+{
+    u32 cmdID = PACK_CMD((u32)data[0], (u32)data[1], Utils::get16(&data[2]));
+    u32 key   = ((u32)data[0] << 24) | ((u32)data[1] << 16) | (data[2] << 8);
+
+    for (u8 i = 0; i < sizeof(TBL_LIST_CMDS) / sizeof(TBL_LIST_CMDS[0]); i++) {
+        if (TBL_LIST_CMDS[i] == cmdID)
+            return key | (size > 4 ? data[4] : 0);
+    }
+    return key;
+}
+
+u8 StateCache::getRequestSet(u8 *data, u32 size)
+{
+    if (size < 4 || data[0] != PROJECT_COMMON || Utils::get16(&data[2]) != 0)
+        return SET_NONE;
+    if (data[1] == COMMON_CLASS_COMMON)
+        return SET_STATES;
+    if (data[1] == COMMON_CLASS_SETTINGS)
+        return SET_SETTINGS;
+    return SET_NONE;
+}
+
+u8 StateCache::getEndSet(u8 *data, u32 size)
+{
+    if (size < 4 || data[0] != PROJECT_COMMON || Utils::get16(&data[2]) != 0)
+        return SET_NONE;
+    if (data[1] == COMMON_CLASS_COMMONSTATE)
+        return SET_STATES;
+    if (data[1] == COMMON_CLASS_SETTINGSSTATE)
+        return SET_SETTINGS;
+    return SET_NONE;
+}
+
+s16 StateCache::findEntry(u32 key)
+{
+    for (u8 i = 0; i < mEntryCnt; i++) {
+        if (mEntries[i].key == key && mEntries[i].set != ENTRY_FREE)
+            return i;
+    }
+    return -1;
+}
+
+// squeeze out freed entries and their arena bytes, order is kept
+void StateCache::compact(void)
+{
+    u8  cnt = 0;
+    u16 len = 0;
+
+    for (u8 i = 0; i < mEntryCnt; i++) {
+        ENTRY_T *e = &mEntries[i];
+
+        if (e->set == ENTRY_FREE)
+            continue;
+        memmove(&mArena[len], &mArena[e->off], e->len);
+        e->off = len;
+        len += e->len;
+        mEntries[cnt++] = *e;
+    }
+    mEntryCnt = cnt;
+    mArenaLen = len;
+}
+
+bool StateCache::addEntry(u8 set, u32 key, u8 *data, u32 size)
+{
+    if (size > 0xff)
+        return false;
+
+    // the replay list holds entry indices, no compaction under it
+    if (!mReplaying && (mEntryCnt >= CACHE_MAX_ENTRIES || mArenaLen + size > CACHE_ARENA_LEN))
+        compact();
+    if (mEntryCnt >= CACHE_MAX_ENTRIES || mArenaLen + size > CACHE_ARENA_LEN)
+        return false;
+
+    ENTRY_T *e = &mEntries[mEntryCnt++];
+    e->off = mArenaLen;
+    e->len = size;
+    e->set = set;
+    e->key = key;
+    e->ts  = now();
+    memcpy(&mArena[mArenaLen], data, size);
+    mArenaLen += size;
+
+    return true;
+}
+
+void StateCache::clearSet(u8 set)
+{
+    for (u8 i = 0; i < mEntryCnt; i++) {
+        if ((mEntries[i].set & ~ENTRY_END) == set)
+            mEntries[i].set = ENTRY_FREE;
+    }
+    mComplete[set] = false;
+    mOverflow[set] = false;
+}
+
+// D2C_ACK_SETTINGS body from the drone, known commands are kept up to date
+// and new ones are added while a full answer is being recorded
+void StateCache::record(u8 *data, u32 size)
+{
+    u8  set;
+    u32 key;
+    s16 idx;
+
+    if (size < 4)
+        return;
+
+    set = getEndSet(data, size);
+    if (set != SET_NONE) {
+        if (mRecording == set) {
+            if (!mOverflow[set] && addEntry(set | ENTRY_END, makeKey(data, size), data, size))
+                mComplete[set] = true;
+            Utils::printf("CACHE %d : %s, %d entries %d bytes\n", set, mComplete[set] ? "complete" : "overflow", mEntryCnt, mArenaLen);
+            mRecording = SET_NONE;
+        }
+        return;
+    }
+
+    key = makeKey(data, size);
+    idx = findEntry(key);
+    if (idx >= 0) {
+        ENTRY_T *e = &mEntries[idx];
+
+        if (e->len == size) {
+            memcpy(&mArena[e->off], data, size);
+            e->ts = now();
+            return;
+        }
+        set    = e->set;
+        e->set = ENTRY_FREE;
+        if (!addEntry(set, key, data, size))
+            mOverflow[set] = true;
+        return;
+    }
+
+    if (mRecording != SET_NONE && !addEntry(mRecording, key, data, size))
+        mOverflow[mRecording] = true;
+}
+
+// AllStates / AllSettings from the app, true when it is answered from the cache
+bool StateCache::onAppRequest(u8 *data, u32 size, u8 seq, u32 ip)
+{
+    u8 set = getRequestSet(data, size);
+
+    if (set == SET_NONE)
+        return false;
+
+    // our ack got lost, the app asks again
+    if (mReplaying && set == mReplaySet && seq == mAckSeq && ip == mAppIP) {
+        mAckPending = true;
+        return true;
+    }
+
+    if (!mComplete[set] || mOverflow[set] || mReplaying) {
+        if (mRecording == SET_NONE) {
+            clearSet(set);
+            mRecording = set;
+        }
+        return false;
+    }
+
+    u8 cnt = 0;
+    for (u8 i = 0; i < mEntryCnt; i++) {
+        if (mEntries[i].set == set)
+            mReplayList[cnt++] = i;
+    }
+    for (u8 i = 0; i < mEntryCnt; i++) {
+        if (mEntries[i].set == (set | ENTRY_END))
+            mReplayList[cnt++] = i;
+    }
+
+    memset(mReplayAcked, 0, sizeof(mReplayAcked));
+    mAppIP         = ip;
+    mAckSeq        = seq;
+    mAckPending    = true;
+    mReplaySet     = set;
+    mReplayCnt     = cnt;
+    mReplayBase    = mLastAppSeq + 1;
+    mReplaySent    = 0;
+    mReplayDone    = 0;
+    mReplayTries   = 0;
+    mReplayTS      = 0;
+    mReplayStartTS = millis();
+    mReplaying     = true;
+
+    // the drone frames that follow come after the replayed ones
+    mSeqShift     += cnt;
+    mLastAppSeq   += cnt;
+
+    Utils::printf("CACHE %d : replay %d frames\n", set, cnt);
+    return true;
+}
+
+// app ack for D2C_ACK_SETTINGS, ours are eaten, the drone ones get their seq back
+bool StateCache::onAppAck(u8 *seq)
+{
+    u8 idx = *seq - mReplayBase;
+
+    // the range is only ours while the replay runs, the seq wraps into it later
+    if (mReplaying && idx < mReplayCnt) {
+        mReplayAcked[idx] = true;
+        return true;
+    }
+    *seq -= mSeqShift;
+    return false;
+}
+
+// next frame for the app, 0 when there is nothing to send now
+int StateCache::pump(u8 *buf, u32 size)
+{
+    u32 ts = millis();
+
+    if (mAckPending) {
+        mAckPending = false;
+        return Bebop::buildCmd(buf, FRAME_TYPE_ACK, 0x80 | BUFFER_ID_C2D_SETTINGS, "B", mAckSeq);
+    }
+
+    if (!mReplaying)
+        return 0;
+
+    while (mReplayDone < mReplayCnt && mReplayAcked[mReplayDone]) {
+        mReplayDone++;
+        mReplayTries = 0;
+    }
+
+    if (mReplayDone == mReplayCnt) {
+        Utils::printf("CACHE %d : replayed in %d ms\n", mReplaySet, ts - mReplayStartTS);
+        mReplaying = false;
+        mReplayCnt = 0;
+        return 0;
+    }
+
+    // go back to the oldest unacked frame
+    if (mReplaySent > mReplayDone && ts - mReplayTS >= REPLAY_RETRY_MS) {
+        if (++mReplayTries > REPLAY_MAX_TRIES) {
+            Utils::printf("CACHE %d : replay aborted at %d / %d\n", mReplaySet, mReplayDone, mReplayCnt);
+            mReplaying = false;
+            mReplayCnt = 0;
+            return 0;
+        }
+        mReplaySent = mReplayDone;
+    }
+
+    while (mReplaySent < mReplayCnt && mReplayAcked[mReplaySent])
+        mReplaySent++;
+
+    if (mReplaySent >= mReplayCnt || mReplaySent >= mReplayDone + REPLAY_WINDOW)
+        return 0;
+
+    ENTRY_T *e = &mEntries[mReplayList[mReplaySent]];
+    if (HEADER_LEN + e->len > size)
+        return 0;
+
+    buf[0] = FRAME_TYPE_DATA_WITH_ACK;
+    buf[1] = BUFFER_ID_D2C_ACK_SETTINGS;
+    buf[2] = mReplayBase + mReplaySent;
+    Utils::put32(&buf[3], HEADER_LEN + e->len);
+    memcpy(&buf[HEADER_LEN], &mArena[e->off], e->len);
+
+    mReplaySent++;
+    mReplayTS = ts;
+    return HEADER_LEN + e->len;
+}
@@ -0,0 +1,104 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _STATE_CACHE_H_
+#define _STATE_CACHE_H_
+
+#include "Common.h"
+#include "ClockSync.h"
+
+#define CACHE_ARENA_LEN     3072
+#define CACHE_MAX_ENTRIES   160
+#define REPLAY_WINDOW       8
+#define REPLAY_RETRY_MS     100
+#define REPLAY_MAX_TRIES    5
+
+// keeps the drone answers to AllStates / AllSettings and plays them back to a
+// reconnecting app, D2C_ACK_SETTINGS seq ids towards the app are shifted by
+// the number of replayed frames so both streams stay in order
+class StateCache
+{
+public:
+    enum {
+        SET_STATES = 0,
+        SET_SETTINGS,
+        SET_MAX,
+        SET_NONE = 0xff,
+    };
+
+    StateCache();
+
+    void reset(void);
+    void setClockSync(ClockSync *clock)     { mClock = clock; }
+    bool isComplete(u8 set)                 { return mComplete[set]; }
+    bool isReplaying(void)                  { return mReplaying; }
+
+    // drone side
+    void record(u8 *data, u32 size);
+    u8   shiftSeq(u8 seq)                   { mLastAppSeq = seq + mSeqShift; return mLastAppSeq; }
+
+    // app side
+    bool onAppRequest(u8 *data, u32 size, u8 seq, u32 ip);
+    u32  getAppIP(void)                     { return mAppIP; }    // the replay goes to this app only
+    bool onAppAck(u8 *seq);
+    int  pump(u8 *buf, u32 size);
+
+private:
+    typedef struct {
+        u16 off;
+        u8  len;
+        u8  set;
+        u32 key;
+        u32 ts;             // drone clock when it was last updated
+    } ENTRY_T;
+
+    ClockSync   *mClock;
+
+    u8      mArena[CACHE_ARENA_LEN];
+    u16     mArenaLen;
+    ENTRY_T mEntries[CACHE_MAX_ENTRIES];
+    u8      mEntryCnt;
+
+    bool    mComplete[SET_MAX];
+    bool    mOverflow[SET_MAX];
+    u8      mRecording;
+
+    u8      mSeqShift;
+    u8      mLastAppSeq;
+
+    u32     mAppIP;
+    bool    mAckPending;
+    u8      mAckSeq;
+    u8      mReplaySet;
+    bool    mReplaying;
+    u8      mReplayList[CACHE_MAX_ENTRIES];
+    bool    mReplayAcked[CACHE_MAX_ENTRIES];
+    u8      mReplayCnt;
+    u8      mReplayBase;
+    u8      mReplaySent;
+    u8      mReplayDone;
+    u8      mReplayTries;
+    u32     mReplayTS;
+    u32     mReplayStartTS;
+
+    static u32 makeKey(u8 *data, u32 size);
+    static u8  getRequestSet(u8 *data, u32 size);
+    static u8  getEndSet(u8 *data, u32 size);
+    s16  findEntry(u32 key);
+    bool addEntry(u8 set, u32 key, u8 *data, u32 size);
+    void clearSet(u8 set);
+    void compact(void);
+    u32  now(void);
+};
+
+#endif
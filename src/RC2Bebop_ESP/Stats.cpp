@@ -0,0 +1,190 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <string.h>
+#include "Stats.h"
+#include "Utils.h"
+#include "Bebop.h"
+
+Stats::Stats()
+{
+    memset(mIndex, STATS_NO_SLOT, sizeof(mIndex));
+    memset(mSlots, 0, sizeof(mSlots));
+    memset(mMalformed, 0, sizeof(mMalformed));
+    mSlotCnt = 0;
+    mReconnects  = 0;
+    mResumes     = 0;
+    mReconnectMs = 0;
+    mLink    = NULL;
+    mVideo   = NULL;
+}
+
+void Stats::begin(int port)
+{
+    mUDP.begin(port);
+    Utils::printf("Stats port : %d\n", mUDP.localPort());
+}
+
+// slots are handed out on first sight of a buffer id, then it is a table lookup
+Stats::SLOT_T *Stats::getSlot(u8 dir, u8 id)
+{
+    u8 idx = mIndex[dir][id];
+
+    if (idx == STATS_NO_SLOT) {
+        if (mSlotCnt >= STATS_MAX_SLOTS)
+            return NULL;
+        idx = mSlotCnt++;
+        mIndex[dir][id] = idx;
+        mSlots[idx].dir = dir;
+        mSlots[idx].id  = id;
+    }
+    return &mSlots[idx];
+}
+
+void Stats::addFrame(u8 dir, u8 type, u8 id, u8 seq, u32 len)
+{
+    SLOT_T *slot = getSlot(dir, id);
+
+    if (!slot)
+        return;
+
+    slot->frames++;
+    slot->bytes += len;
+    slot->types |= BV(type & 0x07);
+    if (type >= FRAME_TYPE_ACK && type < FRAME_TYPE_ACK + STATS_TYPES)
+        slot->typeFrames[type - FRAME_TYPE_ACK]++;
+    if (type == FRAME_TYPE_DATA_WITH_ACK) {
+        slot->ackSeq = seq;
+        slot->ackTS  = millis();
+    }
+}
+
+// an ack (id 0x80 | buffer) going the other way for the frame we saw last
+void Stats::addAck(u8 dir, u8 id, u8 seq)
+{
+    u8 idx = mIndex[dir ^ 1][id & 0x7f];
+
+    if (idx == STATS_NO_SLOT)
+        return;
+
+    SLOT_T *slot = &mSlots[idx];
+    if (slot->ackTS == 0 || slot->ackSeq != seq)
+        return;
+
+    u32 latency = millis() - slot->ackTS;
+    slot->ackTS  = 0;
+    slot->acks++;
+    slot->ackSum += latency;
+    if (latency > slot->ackMax)
+        slot->ackMax = min(latency, (u32)0xffff);
+}
+
+// a late frame fills a gap counted before
+void Stats::addSeq(u8 dir, u8 id, u8 state, u8 gap)
+{
+    SLOT_T *slot = getSlot(dir, id);
+
+    if (!slot)
+        return;
+
+    switch (state) {
+        case SeqTracker::SEQ_GAP:
+            slot->gaps += gap;
+            break;
+
+        case SeqTracker::SEQ_LATE:
+            slot->late++;
+            if (slot->gaps > 0)
+                slot->gaps--;
+            break;
+
+        case SeqTracker::SEQ_DUP:
+            slot->dups++;
+            break;
+
+        case SeqTracker::SEQ_STALE:
+            slot->stale++;
+            break;
+    }
+}
+
+// resumed : the old drone session went on without a new discovery
+void Stats::addReconnect(u32 ms, bool resumed)
+{
+    mReconnects++;
+    if (resumed)
+        mResumes++;
+    mReconnectMs = ms;
+}
+
+int Stats::snapshot(u8 *buf, int size)
+{
+    int idx = 0;
+
+    if (size < STATS_HEADER_LEN + mSlotCnt * STATS_SLOT_LEN)
+        return 0;
+
+    idx += Utils::put32(&buf[idx], STATS_MAGIC);
+    idx += Utils::put8(&buf[idx], STATS_VERSION);
+    idx += Utils::put8(&buf[idx], mSlotCnt);
+    idx += Utils::put32(&buf[idx], millis());
+    idx += Utils::put32(&buf[idx], mMalformed[DIR_C2D]);
+    idx += Utils::put32(&buf[idx], mMalformed[DIR_D2C]);
+    idx += Utils::put32(&buf[idx], mLink ? mLink->getRTT()    : 0);
+    idx += Utils::put32(&buf[idx], mLink ? mLink->getJitter() : 0);
+    idx += Utils::put16(&buf[idx], mLink ? mLink->getLoss()   : 0);
+    idx += Utils::put16(&buf[idx], mLink ? mLink->getRSSI()   : 0);
+    idx += Utils::put8(&buf[idx],  mLink ? mLink->getQuality() : 0);
+    idx += Utils::put8(&buf[idx],  mVideo ? mVideo->isThrottled() : 0);
+    idx += Utils::put16(&buf[idx], mVideo ? mVideo->getFragLoss() : 0);
+    idx += Utils::put16(&buf[idx], mReconnects);
+    idx += Utils::put16(&buf[idx], mResumes);
+    idx += Utils::put32(&buf[idx], mReconnectMs);
+
+    for (u8 i = 0; i < mSlotCnt; i++) {
+        SLOT_T *slot = &mSlots[i];
+
+        idx += Utils::put8(&buf[idx], slot->dir);
+        idx += Utils::put8(&buf[idx], slot->id);
+        idx += Utils::put8(&buf[idx], slot->types);
+        idx += Utils::put8(&buf[idx], 0);
+        idx += Utils::put32(&buf[idx], slot->frames);
+        idx += Utils::put32(&buf[idx], slot->bytes);
+        idx += Utils::put16(&buf[idx], slot->gaps);
+        idx += Utils::put16(&buf[idx], slot->dups);
+        idx += Utils::put16(&buf[idx], slot->late);
+        idx += Utils::put16(&buf[idx], slot->acks);
+        idx += Utils::put16(&buf[idx], slot->ackMax);
+        idx += Utils::put32(&buf[idx], slot->ackSum);
+        for (u8 t = 0; t < STATS_TYPES; t++)
+            idx += Utils::put32(&buf[idx], slot->typeFrames[t]);
+        idx += Utils::put16(&buf[idx], slot->stale);
+    }
+    return idx;
+}
+
+// any datagram to the stats port is answered with a snapshot
+void Stats::process(void)
+{
+    u8  buf[STATS_HEADER_LEN + STATS_MAX_SLOTS * STATS_SLOT_LEN];
+    int size;
+
+    if (mUDP.parsePacket() <= 0)
+        return;
+
+    size = snapshot(buf, sizeof(buf));
+    mUDP.beginPacket(mUDP.remoteIP(), mUDP.remotePort());
+    mUDP.write(buf, size);
+    mUDP.endPacket();
+}
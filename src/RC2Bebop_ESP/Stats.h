@@ -0,0 +1,96 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <WiFiUdp.h>
+#include "Common.h"
+#include "LinkQuality.h"
+#include "VideoThrottle.h"
+#include "SeqTracker.h"
+
+#define STATS_PORT          55000
+#define STATS_MAGIC         0x53425252  // "RRBS"
+#define STATS_VERSION       5
+#define STATS_MAX_SLOTS     24
+#define STATS_NO_SLOT       0xff
+
+// snapshot, little endian
+//  header : magic(4), version, slots, uptime ms(4), malformed c2d(4), malformed d2c(4),
+//           rtt us(4), jitter us(4), ping loss(2), rssi(2), quality, video throttled, frag loss(2),
+//           reconnects(2), resumed sessions(2), last reconnect ms(4)
+//  slot   : dir, id, types, pad, frames(4), bytes(4), gaps(2), dups(2), late(2), acks(2), ack max ms(2), ack sum ms(4),
+//           frames per type(4 x 4) : ack, data, low latency, data with ack, stale(2)
+#define STATS_HEADER_LEN    42
+#define STATS_SLOT_LEN      44
+#define STATS_TYPES         4       // FRAME_TYPE_ACK ~ FRAME_TYPE_DATA_WITH_ACK
+
+class Stats
+{
+public:
+    enum {
+        DIR_C2D = 0,        // app to drone
+        DIR_D2C,            // drone to app
+        DIR_MAX,
+    };
+
+    Stats();
+
+    void begin(int port = STATS_PORT);
+    void process(void);
+    void setLinkQuality(LinkQuality *link)      { mLink = link; }
+    void setVideoThrottle(VideoThrottle *video) { mVideo = video; }
+
+    void addFrame(u8 dir, u8 type, u8 id, u8 seq, u32 len);
+    void addAck(u8 dir, u8 id, u8 seq);
+    void addSeq(u8 dir, u8 id, u8 state, u8 gap);
+    void addMalformed(u8 dir)                   { mMalformed[dir]++; }
+    void addReconnect(u32 ms, bool resumed);
+    int  snapshot(u8 *buf, int size);
+
+private:
+    typedef struct {
+        u8  dir;
+        u8  id;
+        u8  types;          // bit per frame type
+        u8  ackSeq;         // last data with ack frame waiting for its ack
+        u32 ackTS;
+        u32 frames;
+        u32 bytes;
+        u16 gaps;
+        u16 dups;
+        u16 late;
+        u16 acks;
+        u16 ackMax;
+        u32 ackSum;
+        u32 typeFrames[STATS_TYPES];
+        u16 stale;
+    } SLOT_T;
+
+    WiFiUDP mUDP;
+    u8      mIndex[DIR_MAX][256];
+    SLOT_T  mSlots[STATS_MAX_SLOTS];
+    u8      mSlotCnt;
+    u32     mMalformed[DIR_MAX];
+    u16     mReconnects;
+    u16     mResumes;
+    u32     mReconnectMs;
+
+    LinkQuality   *mLink;
+    VideoThrottle *mVideo;
+
+    SLOT_T *getSlot(u8 dir, u8 id);
+};
+
+#endif
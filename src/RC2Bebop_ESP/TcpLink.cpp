@@ -0,0 +1,219 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+#include "TcpLink.h"
+#include "Utils.h"
+
+TcpConn::TcpConn()
+{
+    mPcb    = NULL;
+    mState  = TCP_IDLE;
+    mRxHead = 0;
+    mRxTail = 0;
+}
+
+TcpConn::~TcpConn()
+{
+    close();
+}
+
+// returns right away, the state goes to TCP_CONNECTED or TCP_ERROR later
+bool TcpConn::connect(IPAddress ip, u16 port)
+{
+    ip_addr_t addr;
+
+    close();
+    mPcb = tcp_new();
+    if (!mPcb) {
+        mState = TCP_ERROR;
+        return false;
+    }
+    attach(mPcb);
+    mState = TCP_CONNECTING;
+    mRemoteIP = ip;
+
+    addr.addr = (u32)ip;
+    if (tcp_connect(mPcb, &addr, port, onConnected) != ERR_OK) {
+        close();
+        mState = TCP_ERROR;
+        return false;
+    }
+    return true;
+}
+
+void TcpConn::attach(struct tcp_pcb *pcb)
+{
+    mPcb    = pcb;
+    mState  = TCP_CONNECTED;
+    mRxHead = 0;
+    mRxTail = 0;
+    mRemoteIP = IPAddress(pcb->remote_ip.addr);
+
+    tcp_arg(pcb, this);
+    tcp_recv(pcb, onRecv);
+    tcp_err(pcb, onError);
+    tcp_nagle_disable(pcb);
+}
+
+void TcpConn::close(void)
+{
+    if (mPcb) {
+        tcp_arg(mPcb, NULL);
+        tcp_recv(mPcb, NULL);
+        tcp_err(mPcb, NULL);
+        if (tcp_close(mPcb) != ERR_OK)
+            tcp_abort(mPcb);
+        mPcb = NULL;
+    }
+    mState = TCP_IDLE;
+}
+
+int TcpConn::read(u8 *buf, int size)
+{
+    int len = 0;
+
+    while (len < size && mRxTail != mRxHead) {
+        buf[len++] = mRx[mRxTail];
+        mRxTail = (mRxTail + 1) & (TCP_RX_LEN - 1);
+    }
+    return len;
+}
+
+// queued in lwip, false when the send buffer is short. never waits for the ack
+bool TcpConn::write(const char *str)
+{
+    u16 len = strlen(str);
+
+    if (!mPcb || mState != TCP_CONNECTED || tcp_sndbuf(mPcb) < len)
+        return false;
+
+    if (tcp_write(mPcb, str, len, TCP_WRITE_FLAG_COPY) != ERR_OK)
+        return false;
+    tcp_output(mPcb);
+
+    return true;
+}
+
+IPAddress TcpConn::remoteIP(void)
+{
+    return mRemoteIP;
+}
+
+err_t TcpConn::onConnected(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+    TcpConn *conn = (TcpConn*)arg;
+
+    if (conn)
+        conn->mState = TCP_CONNECTED;
+    return ERR_OK;
+}
+
+// what does not fit in the ring is dropped, the discovery messages are far smaller
+err_t TcpConn::onRecv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    TcpConn *conn = (TcpConn*)arg;
+
+    if (!p) {
+        if (conn)
+            conn->mState = TCP_CLOSED;
+        return ERR_OK;
+    }
+
+    if (conn) {
+        u16 room = TCP_RX_LEN - 1 - conn->available();
+        u16 len  = min(p->tot_len, room);
+
+        for (u16 i = 0; i < len; ) {
+            u16 chunk = min((u16)(len - i), (u16)(TCP_RX_LEN - conn->mRxHead));
+
+            pbuf_copy_partial(p, &conn->mRx[conn->mRxHead], chunk, i);
+            conn->mRxHead = (conn->mRxHead + chunk) & (TCP_RX_LEN - 1);
+            i += chunk;
+        }
+    }
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+
+    return ERR_OK;
+}
+
+// the pcb is already freed by lwip
+void TcpConn::onError(void *arg, err_t err)
+{
+    TcpConn *conn = (TcpConn*)arg;
+
+    if (conn) {
+        conn->mPcb   = NULL;
+        conn->mState = TCP_ERROR;
+    }
+}
+
+
+TcpListener::TcpListener(u16 port)
+{
+    mPcb  = NULL;
+    mPort = port;
+    mNew  = false;
+}
+
+bool TcpListener::begin(void)
+{
+    struct tcp_pcb *pcb;
+
+    if (mPcb)
+        return true;
+
+    pcb = tcp_new();
+    if (!pcb)
+        return false;
+
+    if (tcp_bind(pcb, IP_ADDR_ANY, mPort) != ERR_OK) {
+        tcp_close(pcb);
+        return false;
+    }
+
+    mPcb = tcp_listen(pcb);
+    if (!mPcb) {
+        tcp_close(pcb);
+        return false;
+    }
+    tcp_arg(mPcb, this);
+    tcp_accept(mPcb, onAccept);
+    Utils::printf("TCP listen : %d\n", mPort);
+
+    return true;
+}
+
+bool TcpListener::hasClient(void)
+{
+    bool ret = mNew;
+
+    mNew = false;
+    return ret;
+}
+
+err_t TcpListener::onAccept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+    TcpListener *listener = (TcpListener*)arg;
+
+    if (!listener || err != ERR_OK)
+        return ERR_MEM;
+
+    tcp_accepted(listener->mPcb);
+    listener->mConn.close();
+    listener->mConn.attach(pcb);
+    listener->mNew = true;
+
+    return ERR_OK;
+}
@@ -0,0 +1,85 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _TCP_LINK_H_
+#define _TCP_LINK_H_
+
+#include <Arduino.h>
+#include "Common.h"
+
+extern "C" {
+#include "lwip/tcp.h"
+}
+
+#define TCP_RX_LEN      512
+
+// tcp connection on the raw lwip api, nothing here waits.
+// the lwip callbacks run between two loop() calls, so the rx ring needs no locking.
+class TcpConn
+{
+public:
+    enum {
+        TCP_IDLE = 0,
+        TCP_CONNECTING,
+        TCP_CONNECTED,
+        TCP_CLOSED,         // closed by the peer
+        TCP_ERROR,          // refused, reset or out of memory
+    };
+
+    TcpConn();
+    ~TcpConn();
+
+    bool connect(IPAddress ip, u16 port);
+    void attach(struct tcp_pcb *pcb);
+    void close(void);
+
+    u8   getState(void)     { return mState; }
+    bool isConnected(void)  { return mState == TCP_CONNECTED; }
+    int  available(void)    { return (mRxHead - mRxTail) & (TCP_RX_LEN - 1); }
+    int  read(u8 *buf, int size);
+    bool write(const char *str);
+    IPAddress remoteIP(void);
+
+private:
+    struct tcp_pcb *mPcb;
+    u8   mState;
+    u8   mRx[TCP_RX_LEN];
+    u16  mRxHead;
+    u16  mRxTail;
+    IPAddress mRemoteIP;
+
+    static err_t onConnected(void *arg, struct tcp_pcb *pcb, err_t err);
+    static err_t onRecv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
+    static void  onError(void *arg, err_t err);
+};
+
+// one client at a time, a new one replaces the old one
+class TcpListener
+{
+public:
+    TcpListener(u16 port);
+
+    bool begin(void);
+    bool hasClient(void);
+    TcpConn *getClient(void)    { return &mConn; }
+
+private:
+    struct tcp_pcb *mPcb;
+    u16     mPort;
+    bool    mNew;
+    TcpConn mConn;
+
+    static err_t onAccept(void *arg, struct tcp_pcb *pcb, err_t err);
+};
+
+#endif
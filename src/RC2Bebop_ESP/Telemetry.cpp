@@ -0,0 +1,75 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include "Telemetry.h"
+#include "Bebop.h"
+#include "NavServer.h"
+#include "Utils.h"
+
+Telemetry::Telemetry()
+{
+    mLink  = NULL;
+    mVideo = NULL;
+    reset();
+}
+
+void Telemetry::reset(void)
+{
+    mBattery     = TELEMETRY_UNKNOWN;
+    mFlyingState = TELEMETRY_UNKNOWN;
+    mAlertState  = TELEMETRY_UNKNOWN;
+}
+
+// whole frame, header first
+void Telemetry::onFrame(u8 *frame, u32 size)
+{
+    u8  *body = &frame[HEADER_LEN];
+
+    if (size < HEADER_LEN + 5)
+        return;
+    if (frame[1] != BUFFER_ID_D2C_ACK_SETTINGS && frame[1] != BUFFER_ID_D2C_RPT)
+        return;
+
+    switch (PACK_CMD(body[0], body[1], Utils::get16(&body[2]))) {
+        case PACK_CMD(PROJECT_COMMON, COMMON_CLASS_COMMONSTATE, 1):
+            mBattery = body[4];
+            break;
+
+        case PACK_CMD(PROJECT_ARDRONE3, ARDRONE3_CLASS_PILOTINGSTATE, 1):
+            mFlyingState = body[4];
+            break;
+
+        case PACK_CMD(PROJECT_ARDRONE3, ARDRONE3_CLASS_PILOTINGSTATE, 2):
+            mAlertState = body[4];
+            break;
+    }
+}
+
+int Telemetry::build(u8 *buf, u8 flags, u8 apps)
+{
+    s16 rssi = mLink ? mLink->getRSSI() : 0;
+
+    if (mVideo && mVideo->isThrottled())
+        flags |= TELEMETRY_THROTTLED;
+
+    buf[0] = mBattery;
+    buf[1] = (u8)(s8)constrain(rssi, -128, 0);
+    buf[2] = mFlyingState;
+    buf[3] = mAlertState;
+    buf[4] = mLink ? mLink->getQuality() : 0;
+    buf[5] = flags;
+    buf[6] = apps;
+
+    return TELEMETRY_LEN;
+}
@@ -0,0 +1,51 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include "Common.h"
+#include "LinkQuality.h"
+#include "VideoThrottle.h"
+
+#define TELEMETRY_LEN           7
+#define TELEMETRY_UNKNOWN       0xff
+
+// flags
+#define TELEMETRY_LINK_UP       0x01    // drone traffic within the last second
+#define TELEMETRY_THROTTLED     0x02    // video off for the link
+#define TELEMETRY_FAILSAFE      0x04    // RC failsafe action running
+
+// the last drone states the AVR shows to the pilot
+// payload : battery %, rssi dBm (s8), flying state, alert state, link quality, flags, app count
+class Telemetry
+{
+public:
+    Telemetry();
+
+    void reset(void);
+    void setLinkQuality(LinkQuality *link)      { mLink = link; }
+    void setVideoThrottle(VideoThrottle *video) { mVideo = video; }
+    void onFrame(u8 *frame, u32 size);
+    int  build(u8 *buf, u8 flags, u8 apps);
+
+private:
+    u8  mBattery;
+    u8  mFlyingState;
+    u8  mAlertState;
+
+    LinkQuality   *mLink;
+    VideoThrottle *mVideo;
+};
+
+#endif
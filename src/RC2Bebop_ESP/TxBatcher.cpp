@@ -0,0 +1,102 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include <string.h>
+#include "TxBatcher.h"
+#include "Utils.h"
+
+TxBatcher::TxBatcher(WiFiUDP *udp)
+{
+    mUDP      = udp;
+    mDestPort = 0;
+    mLen      = 0;
+    mFrameCnt = 0;
+    mFirstTS  = 0;
+    mPackets  = 0;
+    mFrames   = 0;
+    mCap      = NULL;
+}
+
+void TxBatcher::setDest(IPAddress destIP, int destPort)
+{
+    if (destIP != mDestIP || destPort != mDestPort)
+        flush();
+    mDestIP   = destIP;
+    mDestPort = destPort;
+}
+
+void TxBatcher::send(u8 *data, int size)
+{
+    if (mDestIP[0] == 0 || mDestPort == 0) {
+        Utils::printf("<<< TX ERROR : no dest\n");
+        return;
+    }
+
+    mUDP->beginPacket(mDestIP, mDestPort);
+    mUDP->write(data, size);
+    mUDP->endPacket();
+    if (mCap)
+        mCap->add(Capture::getLocalIP(mDestIP), mUDP->localPort(), mDestIP, mDestPort, data, size);
+    mPackets++;
+}
+
+void TxBatcher::add(u8 *data, int size)
+{
+    if (size <= 0)
+        return;
+
+    mFrames++;
+    if (!fits(size))
+        flush();
+
+    // too big to share a datagram
+    if (size > TX_BATCH_MTU) {
+        send(data, size);
+        return;
+    }
+
+    if (mLen == 0)
+        mFirstTS = millis();
+    memcpy(&mBuf[mLen], data, size);
+    mFrameOfs[mFrameCnt++] = mLen;
+    mLen += size;
+}
+
+void TxBatcher::flush(void)
+{
+    if (mLen == 0)
+        return;
+
+    send(mBuf, mLen);
+    clear();
+}
+
+bool TxBatcher::isDue(void)
+{
+    return mLen > 0 && (millis() - mFirstTS >= TX_BATCH_DEADLINE_MS);
+}
+
+void TxBatcher::poll(void)
+{
+    if (isDue())
+        flush();
+}
+
+u8 *TxBatcher::getFrame(u8 idx, u16 *len)
+{
+    u16 end = (idx + 1 < mFrameCnt) ? mFrameOfs[idx + 1] : mLen;
+
+    *len = end - mFrameOfs[idx];
+    return &mBuf[mFrameOfs[idx]];
+}
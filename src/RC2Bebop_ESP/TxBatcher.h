@@ -0,0 +1,65 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _TX_BATCHER_H_
+#define _TX_BATCHER_H_
+
+#include <WiFiUdp.h>
+#include "Common.h"
+#include "Capture.h"
+
+#define TX_BATCH_MTU            1400    // stay below the 1472 bytes udp payload of a 1500 MTU
+#define TX_BATCH_DEADLINE_MS    5
+#define TX_BATCH_MAX_FRAMES     48
+
+// ARNetwork accepts several frames back to back in one datagram, so frames for
+// the same destination are packed and sent together
+class TxBatcher
+{
+public:
+    TxBatcher(WiFiUDP *udp);
+
+    void setDest(IPAddress destIP, int destPort);
+    void add(u8 *data, int size);
+    void flush(void);
+    void poll(void);                    // flush when the oldest frame is due
+    bool isEmpty(void)                  { return mLen == 0; }
+    void setCapture(Capture *cap)       { mCap = cap; }
+
+    // for the owner sending the batch itself, to several destinations
+    bool fits(int size)                 { return mLen + size <= TX_BATCH_MTU && mFrameCnt < TX_BATCH_MAX_FRAMES; }
+    bool isDue(void);
+    u8   getFrameCnt(void)              { return mFrameCnt; }
+    u8   *getFrame(u8 idx, u16 *len);
+    void clear(void)                    { mLen = 0; mFrameCnt = 0; }
+    u32  getPackets(void)               { return mPackets; }
+    u32  getFrames(void)                { return mFrames;  }
+
+private:
+    WiFiUDP     *mUDP;
+    IPAddress   mDestIP;
+    int         mDestPort;
+
+    u8          mBuf[TX_BATCH_MTU];
+    u16         mLen;
+    u16         mFrameOfs[TX_BATCH_MAX_FRAMES];
+    u8          mFrameCnt;
+    u32         mFirstTS;
+    u32         mPackets;
+    u32         mFrames;
+    Capture     *mCap;
+
+    void send(u8 *data, int size);
+};
+
+#endif
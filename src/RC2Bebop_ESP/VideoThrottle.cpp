@@ -0,0 +1,101 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#include <Arduino.h>
+#include "VideoThrottle.h"
+#include "Utils.h"
+
+VideoThrottle::VideoThrottle()
+{
+    reset();
+}
+
+void VideoThrottle::reset(void)
+{
+    mThrottled    = false;
+    mAppEnable    = false;
+    mHoldTS       = 0;
+    mFrameNo      = 0;
+    mFragCnt      = 0;
+    mFragPerFrame = 0;
+    mFragLoss     = 0;
+}
+
+// ARStream fragment header : frameNo(2), flags, fragNo, fragPerFrame
+// returns true when the fragment should not be forwarded. the stream is off while
+// throttled, the tail of it would only count as loss
+bool VideoThrottle::onVideoFrag(u8 *data, u32 size)
+{
+    if (size < 5 || mThrottled)
+        return mThrottled;
+
+    u16 frameNo = Utils::get16(data);
+
+    if (frameNo != mFrameNo) {
+        if (mFragPerFrame > 0) {
+            u16 lost = (mFragCnt < mFragPerFrame) ? (mFragPerFrame - mFragCnt) * 1000 / mFragPerFrame : 0;
+
+            mFragLoss = mFragLoss - (mFragLoss / 8) + (lost / 8);
+        }
+        mFrameNo = frameNo;
+        mFragCnt = 0;
+    }
+    mFragPerFrame = data[4];
+    mFragCnt++;
+
+    return mThrottled;
+}
+
+// the app asked for video on/off, keep the stream off while throttled
+void VideoThrottle::onAppVideoEnable(u8 *enable)
+{
+    mAppEnable = *enable;
+    if (mThrottled)
+        *enable = 0;
+}
+
+// returns 0 / 1 when video must be disabled / enabled, -1 for no change
+s8 VideoThrottle::update(u32 ts, LinkQuality *link)
+{
+    bool bad;
+    bool good;
+
+    if (!link)
+        return -1;
+
+    bad  = link->getRTT() > VIDEO_OFF_RTT_US || link->getLoss() > VIDEO_OFF_LOSS || mFragLoss > VIDEO_OFF_FRAG_LOSS;
+    good = link->getRTT() < VIDEO_ON_RTT_US  && link->getLoss() < VIDEO_ON_LOSS  && mFragLoss < VIDEO_ON_FRAG_LOSS;
+
+    if ((!mThrottled && !bad) || (mThrottled && !good)) {
+        mHoldTS = ts;
+        return -1;
+    }
+
+    if (!mThrottled && (ts - mHoldTS >= VIDEO_OFF_HOLD_MS)) {
+        Utils::printf("VIDEO off, rtt:%d loss:%d frag:%d\n", link->getRTT(), link->getLoss(), mFragLoss);
+        mThrottled = true;
+        mHoldTS    = ts;
+        mFragLoss  = 0;         // no fragments to measure it until the stream is back
+        mFragPerFrame = 0;
+        return mAppEnable ? 0 : -1;
+    }
+
+    if (mThrottled && (ts - mHoldTS >= VIDEO_ON_HOLD_MS)) {
+        Utils::printf("VIDEO on, rtt:%d loss:%d frag:%d\n", link->getRTT(), link->getLoss(), mFragLoss);
+        mThrottled = false;
+        mHoldTS    = ts;
+        mFragLoss  = 0;
+        return mAppEnable ? 1 : -1;
+    }
+    return -1;
+}
@@ -0,0 +1,57 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _VIDEO_THROTTLE_H_
+#define _VIDEO_THROTTLE_H_
+
+#include "Common.h"
+#include "LinkQuality.h"
+
+// link is marginal when any of them is crossed for VIDEO_OFF_HOLD_MS
+#define VIDEO_OFF_RTT_US        80000
+#define VIDEO_OFF_LOSS          100     // ping loss, 0.1%
+#define VIDEO_OFF_FRAG_LOSS     200     // ARStream fragment loss, 0.1%
+#define VIDEO_OFF_HOLD_MS       1000
+
+// and good again when all of them are below for VIDEO_ON_HOLD_MS
+#define VIDEO_ON_RTT_US         40000
+#define VIDEO_ON_LOSS           20
+#define VIDEO_ON_FRAG_LOSS      50
+#define VIDEO_ON_HOLD_MS        5000
+
+// turns the drone video stream off while the control path suffers and back on
+// when it has recovered, only if the app asked for video
+class VideoThrottle
+{
+public:
+    VideoThrottle();
+
+    void reset(void);
+    bool onVideoFrag(u8 *data, u32 size);
+    void onAppVideoEnable(u8 *enable);
+    s8   update(u32 ts, LinkQuality *link);
+    bool isThrottled(void)      { return mThrottled;  }
+    u16  getFragLoss(void)      { return mFragLoss;   }
+
+private:
+    bool    mThrottled;
+    bool    mAppEnable;
+    u32     mHoldTS;
+
+    u16     mFrameNo;
+    u8      mFragCnt;
+    u8      mFragPerFrame;
+    u16     mFragLoss;
+};
+
+#endif
@@ -0,0 +1,1030 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+// offline ARNetwork session analyzer for pcap captures
+// (packet/*.pkt, ESP captures from Capture.cpp)
+//
+// build : g++ -O2 -std=c++11 -pthread -o rbanalyze rbanalyze.cpp
+// usage : rbanalyze [-j threads] [-v] <capture>
+//
+// the capture is mapped and cut into byte ranges, each one a contiguous time window.
+// a worker finds the first record of its range by itself and decodes it alone,
+// the partial results are merged in time order. memory does not grow with the capture.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "../RC2Bebop_ESP/ARCOMMANDS_Ids.h"
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef int32_t  s32;
+typedef uint32_t u32;
+typedef int64_t  s64;
+typedef uint64_t u64;
+
+// ARNetwork
+#define HEADER_LEN          7
+#define FRAME_TYPE_ACK      1
+#define FRAME_TYPE_DATA     2
+#define FRAME_TYPE_DATA_LOW_LATENCY 3
+#define FRAME_TYPE_DATA_WITH_ACK    4
+#define BUFFER_ID_PING      0
+#define BUFFER_ID_PONG      1
+#define BUFFER_ID_C2D_PCMD  10
+#define BUFFER_ID_D2C_VID   125
+#define ACK_ID_OFFSET       0x80
+
+#define SHARD_MIN_LEN       (1 << 20)
+#define SYNC_CHAIN          4           // headers in a row to trust a record boundary
+#define GRACE_US            2000000     // read past the range end for the acks
+#define PENDING_LEN         8192        // power of 2
+#define PENDING_PROBES      16
+#define IA_BUCKETS          16          // log2 ms, <1ms .. >=16s
+#define PCMD_BINS           500         // 1ms
+#define MAX_EVENTS          65536       // per range
+
+enum {
+    EV_FLYING = 0,
+    EV_ALERT,
+    EV_BATTERY,
+};
+
+static const char *TBL_FLYING[] = { "landed", "takingoff", "hovering", "flying", "landing", "emergency",
+    "usertakeoff", "motor_ramping", "emergency_landing" };
+static const char *TBL_ALERT[]  = { "none", "user", "cut_out", "critical_battery", "low_battery", "too_much_angle" };
+
+static u16 get16(const u8 *buf) { return buf[0] | (buf[1] << 8); }
+static u32 get32(const u8 *buf) { return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((u32)buf[3] << 24); }
+static u16 getBE16(const u8 *buf) { return (buf[0] << 8) | buf[1]; }
+
+static const char *bufferName(u8 id)
+{
+    switch (id) {
+        case 0:     return "PING";
+        case 1:     return "PONG";
+        case 10:    return "PCMD";
+        case 11:    return "SETTINGS";
+        case 12:    return "EMERGENCY";
+        case 13:    return "VID_ACK";
+        case 125:   return "VIDEO";
+        case 126:   return "ACK_SETTINGS";
+        case 127:   return "REPORT";
+        case 0xfe:  return "ACKACK";
+    }
+    return (id & 0x80) ? "ACK" : "?";
+}
+
+static void ipStr(u32 ip, char *buf)
+{
+    sprintf(buf, "%d.%d.%d.%d", ip & 0xff, (ip >> 8) & 0xff, (ip >> 16) & 0xff, ip >> 24);
+}
+
+/*
+*****************************************************************************************
+* pcap
+*****************************************************************************************
+*/
+struct Pcap {
+    const u8 *base;
+    u64     size;
+    bool    swap;
+    bool    nsec;
+    u32     snap;
+    u32     link;
+    u32     firstSec;
+
+    u32 rd32(const u8 *p) const
+    {
+        u32 v = get32(p);
+        return swap ? __builtin_bswap32(v) : v;
+    }
+
+    bool open(const u8 *buf, u64 len)
+    {
+        base = buf;
+        size = len;
+        if (size < 24)
+            return false;
+
+        switch (get32(buf)) {
+            case 0xa1b2c3d4:    swap = false; nsec = false; break;
+            case 0xa1b23c4d:    swap = false; nsec = true;  break;
+            case 0xd4c3b2a1:    swap = true;  nsec = false; break;
+            case 0x4d3cb2a1:    swap = true;  nsec = true;  break;
+            default:            return false;
+        }
+        snap = rd32(&buf[16]);
+        link = rd32(&buf[20]) & 0xffff;
+        if (snap == 0 || snap > 262144)
+            snap = 262144;
+        firstSec = (size >= 40) ? rd32(&buf[24]) : 0;
+        return true;
+    }
+
+    // plausible record header at ofs
+    bool isHeader(u64 ofs) const
+    {
+        if (ofs + 16 > size)
+            return false;
+
+        const u8 *p = &base[ofs];
+        u32 sec  = rd32(p);
+        u32 frac = rd32(&p[4]);
+        u32 incl = rd32(&p[8]);
+        u32 orig = rd32(&p[12]);
+
+        return incl <= snap && incl <= orig && orig <= 262144 && ofs + 16 + incl <= size &&
+            frac < (nsec ? 1000000000u : 1000000u) && (u64)sec + 1 >= firstSec && sec <= (u64)firstSec + 10 * 365 * 86400u;
+    }
+
+    // first record boundary at or after ofs, the same answer for every worker
+    u64 sync(u64 ofs) const
+    {
+        if (ofs <= 24)
+            return 24;
+
+        for (; ofs + 16 <= size; ofs++) {
+            u64  next = ofs;
+            int  i;
+
+            for (i = 0; i < SYNC_CHAIN && next < size; i++) {
+                if (!isHeader(next))
+                    break;
+                next += 16 + rd32(&base[next + 8]);
+            }
+            if (i == SYNC_CHAIN || next == size)
+                return ofs;
+        }
+        return size;
+    }
+
+    u64 getTS(u64 ofs) const
+    {
+        u64 frac = rd32(&base[ofs + 4]);
+        return (u64)rd32(&base[ofs]) * 1000000 + (nsec ? frac / 1000 : frac);
+    }
+};
+
+/*
+*****************************************************************************************
+* per range results
+*****************************************************************************************
+*/
+struct BufStat {
+    u64     frames;
+    u64     bytes;
+    u64     firstTS;
+    u64     lastTS;
+    int     firstSeq;
+    int     lastSeq;
+    u64     hist[IA_BUCKETS];
+    u32     gaps;
+    u32     dups;
+
+    BufStat() { memset(this, 0, sizeof(*this)); firstSeq = lastSeq = -1; }
+};
+
+struct RttStat {
+    u64     cnt;
+    u64     sum;
+    u64     min;
+    u64     max;
+    u64     hist[IA_BUCKETS];
+    u32     retrans;
+    u32     unacked;
+
+    RttStat() { memset(this, 0, sizeof(*this)); min = ~0ULL; }
+};
+
+struct PcmdStat {
+    u64     firstTS;
+    u64     lastTS;
+    u64     cnt;            // intervals
+    double  sum;
+    double  sumSq;
+    u64     max;
+    u32     bins[PCMD_BINS + 1];
+
+    PcmdStat() { memset(this, 0, sizeof(*this)); }
+};
+
+struct VidFrame {
+    s32     no;             // -1 none
+    u8      total;
+    u64     bits[2];
+};
+
+struct VidStat {
+    VidFrame head;          // first frame of the range, may have started before
+    VidFrame cur;           // last one, may go on after
+    bool    headDone;
+    u64     frames;
+    u64     lossy;
+    u64     fragsLost;
+    u64     missing;        // whole frames never seen
+    u64     lostHist[5];    // 0, 1, 2, 3-5, 6+ fragments lost
+
+    VidStat() { memset(this, 0, sizeof(*this)); head.no = cur.no = -1; }
+};
+
+struct Event {
+    u64     ts;
+    u8      kind;
+    s32     value;
+};
+
+struct FlowKey {
+    u32     src;
+    u32     dst;
+
+    bool operator<(const FlowKey &o) const { return src != o.src ? src < o.src : dst < o.dst; }
+};
+
+struct Flow {
+    std::map<u8, BufStat> bufs;
+    std::map<u8, RttStat> rtts;
+    PcmdStat    pcmd;
+    VidStat     vid;
+};
+
+struct Pending {
+    u32     src;
+    u32     dst;
+    u64     tag;            // seq, or the ping payload
+    u64     ts;
+    u8      id;
+    bool    used;
+};
+
+struct Range {
+    u64     start;
+    u64     end;
+    u64     firstTS;
+    u64     lastTS;
+    u64     records;
+    u64     datagrams;      // ARNetwork ones
+    u64     frames;
+    u64     others;
+    u64     malformed;
+    u32     eventDrops;
+    std::map<FlowKey, Flow> flows;
+    std::vector<Event> events;
+
+    Range() : start(0), end(0), firstTS(0), lastTS(0), records(0), datagrams(0), frames(0),
+        others(0), malformed(0), eventDrops(0) { }
+};
+
+/*
+*****************************************************************************************
+* decoder
+*****************************************************************************************
+*/
+static int bucketOf(u64 us)
+{
+    u64 ms = us / 1000;
+    int b  = 0;
+
+    while (ms && b < IA_BUCKETS - 1) {
+        ms >>= 1;
+        b++;
+    }
+    return b;
+}
+
+class Decoder
+{
+public:
+    Decoder(const Pcap *pcap, Range *range) : mPcap(pcap), mRange(range)
+    {
+        mPending = new Pending[PENDING_LEN];
+        memset(mPending, 0, sizeof(Pending) * PENDING_LEN);
+    }
+
+    ~Decoder()
+    {
+        delete[] mPending;
+    }
+
+    void run(void);
+
+private:
+    const Pcap  *mPcap;
+    Range       *mRange;
+    Pending     *mPending;
+    bool        mGrace;         // past the range end, acks only
+
+    void datagram(u64 ts, u32 src, u32 dst, const u8 *data, u32 len, u32 wireLen);
+    void frame(u64 ts, Flow &flow, const FlowKey &key, u8 type, u8 id, u8 seq, const u8 *body, u32 len, u32 wireLen);
+    void report(u64 ts, const u8 *body, u32 len);
+    void video(VidStat &vid, const u8 *body, u32 len);
+    void addPending(u32 src, u32 dst, u8 id, u64 tag, u64 ts, RttStat &rtt);
+    bool matchPending(u32 src, u32 dst, u8 id, u64 tag, u64 ts, RttStat &rtt);
+    void addEvent(u64 ts, u8 kind, s32 value);
+};
+
+static u32 hashPending(u32 src, u32 dst, u8 id, u64 tag)
+{
+    u64 h = ((u64)src * 0x9e3779b1) ^ ((u64)dst * 0x85ebca6b) ^ (tag * 0xc2b2ae3d27d4eb4fULL) ^ id;
+
+    return (u32)(h ^ (h >> 29)) & (PENDING_LEN - 1);
+}
+
+void Decoder::addPending(u32 src, u32 dst, u8 id, u64 tag, u64 ts, RttStat &rtt)
+{
+    u32 h = hashPending(src, dst, id, tag);
+
+    for (int i = 0; i < PENDING_PROBES; i++) {
+        Pending *p = &mPending[(h + i) & (PENDING_LEN - 1)];
+
+        if (p->used && p->src == src && p->dst == dst && p->id == id && p->tag == tag) {
+            rtt.retrans++;          // the first send stays the reference
+            return;
+        }
+        if (!p->used) {
+            p->used = true;
+            p->src  = src;
+            p->dst  = dst;
+            p->id   = id;
+            p->tag  = tag;
+            p->ts   = ts;
+            return;
+        }
+    }
+    // table crowded, the oldest probe goes unacked
+    Pending *p = &mPending[h];
+    rtt.unacked++;
+    p->src = src;
+    p->dst = dst;
+    p->id  = id;
+    p->tag = tag;
+    p->ts  = ts;
+}
+
+bool Decoder::matchPending(u32 src, u32 dst, u8 id, u64 tag, u64 ts, RttStat &rtt)
+{
+    u32 h = hashPending(src, dst, id, tag);
+
+    for (int i = 0; i < PENDING_PROBES; i++) {
+        Pending *p = &mPending[(h + i) & (PENDING_LEN - 1)];
+
+        if (p->used && p->src == src && p->dst == dst && p->id == id && p->tag == tag) {
+            u64 us = ts - p->ts;
+
+            rtt.cnt++;
+            rtt.sum += us;
+            rtt.min = std::min(rtt.min, us);
+            rtt.max = std::max(rtt.max, us);
+            rtt.hist[bucketOf(us)]++;
+            p->used = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Decoder::addEvent(u64 ts, u8 kind, s32 value)
+{
+    if (mRange->events.size() >= MAX_EVENTS) {
+        mRange->eventDrops++;
+        return;
+    }
+    Event ev = { ts, kind, value };
+    mRange->events.push_back(ev);
+}
+
+// flying state, alert and battery for the timeline
+void Decoder::report(u64 ts, const u8 *body, u32 len)
+{
+    if (len < 5)
+        return;
+
+    u8  prj = body[0];
+    u8  cls = body[1];
+    u16 cmd = get16(&body[2]);
+
+    if (prj == ARCOMMANDS_ID_PROJECT_ARDRONE3 && cls == ARCOMMANDS_ID_ARDRONE3_CLASS_PILOTINGSTATE && len >= 8) {
+        if (cmd == ARCOMMANDS_ID_ARDRONE3_PILOTINGSTATE_CMD_FLYINGSTATECHANGED)
+            addEvent(ts, EV_FLYING, get32(&body[4]));
+        else if (cmd == ARCOMMANDS_ID_ARDRONE3_PILOTINGSTATE_CMD_ALERTSTATECHANGED)
+            addEvent(ts, EV_ALERT, get32(&body[4]));
+    } else if (prj == ARCOMMANDS_ID_PROJECT_COMMON && cls == ARCOMMANDS_ID_COMMON_CLASS_COMMONSTATE &&
+        cmd == ARCOMMANDS_ID_COMMON_COMMONSTATE_CMD_BATTERYSTATECHANGED) {
+        addEvent(ts, EV_BATTERY, body[4]);
+    }
+}
+
+static void finishFrame(VidStat &vid, const VidFrame &f)
+{
+    int got  = __builtin_popcountll(f.bits[0]) + __builtin_popcountll(f.bits[1]);
+    int lost = std::max(0, f.total - got);
+
+    vid.frames++;
+    if (lost > 0) {
+        vid.lossy++;
+        vid.fragsLost += lost;
+    }
+    vid.lostHist[lost == 0 ? 0 : lost == 1 ? 1 : lost == 2 ? 2 : lost <= 5 ? 3 : 4]++;
+}
+
+static u32 frameGap(s32 from, s32 to)
+{
+    u16 diff = (u16)(to - from);
+
+    return (diff > 1 && diff < 0x8000) ? diff - 1 : 0;
+}
+
+// ARStream fragment : frameNo(2), flags, fragNo, fragPerFrame
+void Decoder::video(VidStat &vid, const u8 *body, u32 len)
+{
+    if (len < 5)
+        return;
+
+    s32 no    = get16(body);
+    u8  frag  = body[3];
+    u8  total = body[4];
+
+    if (no != vid.cur.no) {
+        if (vid.cur.no >= 0) {
+            if (!vid.headDone) {
+                vid.head = vid.cur;
+                vid.headDone = true;
+            } else {
+                finishFrame(vid, vid.cur);
+            }
+            vid.missing += frameGap(vid.cur.no, no);
+        }
+        memset(&vid.cur, 0, sizeof(vid.cur));
+        vid.cur.no = no;
+    }
+    vid.cur.total = std::max(vid.cur.total, total);
+    if (frag < 128)
+        vid.cur.bits[frag >> 6] |= 1ULL << (frag & 0x3f);
+}
+
+// len : body bytes captured, wireLen : the whole frame as it was sent
+void Decoder::frame(u64 ts, Flow &flow, const FlowKey &key, u8 type, u8 id, u8 seq, const u8 *body, u32 len, u32 wireLen)
+{
+    // acks come back on the reverse flow
+    if (type == FRAME_TYPE_ACK && len >= 1 && (id & ACK_ID_OFFSET)) {
+        FlowKey rev = { key.dst, key.src };
+        u8      dataID = id & 0x7f;
+
+        matchPending(rev.src, rev.dst, dataID, body[0], ts, mRange->flows[rev].rtts[dataID]);
+    } else if (id == BUFFER_ID_PONG && len >= 8) {
+        FlowKey rev = { key.dst, key.src };
+
+        matchPending(rev.src, rev.dst, BUFFER_ID_PING, get32(body) | ((u64)get32(&body[4]) << 32),
+            ts, mRange->flows[rev].rtts[BUFFER_ID_PING]);
+    }
+    if (mGrace)
+        return;
+
+    BufStat &buf = flow.bufs[id];
+    if (buf.frames > 0) {
+        u8 diff = seq - buf.lastSeq;
+
+        buf.hist[bucketOf(ts - buf.lastTS)]++;
+        if (diff == 0 || diff >= 0x80)
+            buf.dups++;
+        else
+            buf.gaps += diff - 1;
+    } else {
+        buf.firstTS  = ts;
+        buf.firstSeq = seq;
+    }
+    buf.frames++;
+    buf.bytes   += wireLen;
+    buf.lastTS   = ts;
+    buf.lastSeq  = seq;
+
+    if (type == FRAME_TYPE_DATA_WITH_ACK)
+        addPending(key.src, key.dst, id, seq, ts, flow.rtts[id]);
+    else if (id == BUFFER_ID_PING && len >= 8)
+        addPending(key.src, key.dst, BUFFER_ID_PING, get32(body) | ((u64)get32(&body[4]) << 32), ts, flow.rtts[BUFFER_ID_PING]);
+
+    if (id == BUFFER_ID_C2D_PCMD && len >= 4 && body[0] == ARCOMMANDS_ID_PROJECT_ARDRONE3 &&
+        body[1] == ARCOMMANDS_ID_ARDRONE3_CLASS_PILOTING && get16(&body[2]) == ARCOMMANDS_ID_ARDRONE3_PILOTING_CMD_PCMD) {
+        PcmdStat &pcmd = flow.pcmd;
+
+        if (pcmd.firstTS) {
+            u64 us = ts - pcmd.lastTS;
+
+            pcmd.cnt++;
+            pcmd.sum   += us;
+            pcmd.sumSq += (double)us * us;
+            pcmd.max    = std::max(pcmd.max, us);
+            pcmd.bins[std::min((u64)PCMD_BINS, us / 1000)]++;
+        } else {
+            pcmd.firstTS = ts;
+        }
+        pcmd.lastTS = ts;
+    }
+
+    if (id == BUFFER_ID_D2C_VID && type == FRAME_TYPE_DATA_LOW_LATENCY)
+        video(flow.vid, body, len);
+    else if (type == FRAME_TYPE_DATA || type == FRAME_TYPE_DATA_WITH_ACK)
+        report(ts, body, len);
+}
+
+// every frame must parse, anything else on udp is not ARNetwork.
+// snapped captures (Capture.cpp) keep the headers, the frames past the snap length are not seen
+void Decoder::datagram(u64 ts, u32 src, u32 dst, const u8 *data, u32 len, u32 wireLen)
+{
+    u32  ofs = 0;
+    bool bad = false;
+
+    while (ofs < wireLen && ofs + HEADER_LEN <= len) {
+        u8  type = data[ofs];
+        u32 flen = get32(&data[ofs + 3]);
+
+        if (type < FRAME_TYPE_ACK || type > FRAME_TYPE_DATA_WITH_ACK || flen < HEADER_LEN || ofs + flen > wireLen) {
+            bad = true;
+            break;
+        }
+        ofs += flen;
+    }
+    if (ofs == 0) {
+        if (!mGrace)
+            mRange->others++;
+        return;
+    }
+    if (bad && !mGrace)
+        mRange->malformed++;
+
+    FlowKey key = { src, dst };
+    Flow    &flow = mRange->flows[key];
+
+    if (!mGrace)
+        mRange->datagrams++;
+    for (u32 i = 0; i < ofs; ) {
+        u32 flen = get32(&data[i + 3]);
+
+        u32 cap  = std::min(flen, len - i);
+
+        frame(ts, flow, key, data[i], data[i + 1], data[i + 2], &data[i + HEADER_LEN], cap - HEADER_LEN, flen);
+        if (!mGrace)
+            mRange->frames++;
+        i += flen;
+    }
+}
+
+void Decoder::run(void)
+{
+    u64 ofs = mRange->start;
+    u64 graceEnd = 0;
+
+    mGrace = false;
+    while (ofs + 16 <= mPcap->size) {
+        const u8 *rec = &mPcap->base[ofs];
+        u32 incl = mPcap->rd32(&rec[8]);
+        u64 ts   = mPcap->getTS(ofs);
+        const u8 *pkt = &rec[16];
+        u32 len  = incl;
+
+        if (!mGrace && ofs >= mRange->end) {
+            mGrace   = true;
+            graceEnd = ts + GRACE_US;
+        }
+        if (mGrace && ts > graceEnd)
+            break;
+        if (ofs + 16 + incl > mPcap->size)
+            break;
+        ofs += 16 + incl;
+
+        if (!mGrace) {
+            if (!mRange->records)
+                mRange->firstTS = ts;
+            mRange->lastTS = ts;
+            mRange->records++;
+        }
+
+        // down to ipv4
+        switch (mPcap->link) {
+            case 1:             // ethernet
+                if (len < 14)
+                    continue;
+                if (getBE16(&pkt[12]) == 0x8100 && len >= 18) {
+                    pkt += 4;
+                    len -= 4;
+                }
+                if (getBE16(&pkt[12]) != 0x0800)
+                    continue;
+                pkt += 14;
+                len -= 14;
+                break;
+
+            case 113:           // linux cooked
+                if (len < 16 || getBE16(&pkt[14]) != 0x0800)
+                    continue;
+                pkt += 16;
+                len -= 16;
+                break;
+
+            case 101:           // raw ip
+            case 228:
+                break;
+
+            default:
+                continue;
+        }
+
+        if (len < 20 || (pkt[0] >> 4) != 4 || pkt[9] != 17)
+            continue;
+        u32 ihl = (pkt[0] & 0x0f) * 4;
+        if ((getBE16(&pkt[6]) & 0x1fff) != 0 || len < ihl + 8)
+            continue;   // not the first fragment
+
+        u32 src = get32(&pkt[12]);
+        u32 dst = get32(&pkt[16]);
+        u32 udpLen = getBE16(&pkt[ihl + 4]);
+
+        pkt += ihl + 8;
+        len -= ihl + 8;
+        if (udpLen < 8)
+            continue;
+        datagram(ts, src, dst, pkt, std::min(len, udpLen - 8), udpLen - 8);
+    }
+
+    // what is left in the table was never acked
+    for (int i = 0; i < PENDING_LEN; i++) {
+        Pending *p = &mPending[i];
+
+        if (p->used) {
+            FlowKey key = { p->src, p->dst };
+            mRange->flows[key].rtts[p->id].unacked++;
+        }
+    }
+}
+
+/*
+*****************************************************************************************
+* merge
+*****************************************************************************************
+*/
+static void mergeBuf(BufStat &to, const BufStat &from)
+{
+    if (from.frames == 0)
+        return;
+
+    if (to.frames > 0) {
+        u8 diff = from.firstSeq - to.lastSeq;
+
+        to.hist[bucketOf(from.firstTS - to.lastTS)]++;
+        if (diff == 0 || diff >= 0x80)
+            to.dups++;
+        else
+            to.gaps += diff - 1;
+    } else {
+        to.firstTS  = from.firstTS;
+        to.firstSeq = from.firstSeq;
+    }
+    to.frames += from.frames;
+    to.bytes  += from.bytes;
+    to.gaps   += from.gaps;
+    to.dups   += from.dups;
+    for (int i = 0; i < IA_BUCKETS; i++)
+        to.hist[i] += from.hist[i];
+    to.lastTS  = from.lastTS;
+    to.lastSeq = from.lastSeq;
+}
+
+static void mergeRtt(RttStat &to, const RttStat &from)
+{
+    to.cnt     += from.cnt;
+    to.sum     += from.sum;
+    to.min      = std::min(to.min, from.min);
+    to.max      = std::max(to.max, from.max);
+    to.retrans += from.retrans;
+    to.unacked += from.unacked;
+    for (int i = 0; i < IA_BUCKETS; i++)
+        to.hist[i] += from.hist[i];
+}
+
+static void mergePcmd(PcmdStat &to, const PcmdStat &from)
+{
+    if (from.firstTS == 0)
+        return;
+
+    if (to.firstTS) {
+        u64 us = from.firstTS - to.lastTS;
+
+        to.cnt++;
+        to.sum   += us;
+        to.sumSq += (double)us * us;
+        to.max    = std::max(to.max, us);
+        to.bins[std::min((u64)PCMD_BINS, us / 1000)]++;
+    } else {
+        to.firstTS = from.firstTS;
+    }
+    to.cnt   += from.cnt;
+    to.sum   += from.sum;
+    to.sumSq += from.sumSq;
+    to.max    = std::max(to.max, from.max);
+    for (int i = 0; i <= PCMD_BINS; i++)
+        to.bins[i] += from.bins[i];
+    to.lastTS = from.lastTS;
+}
+
+// the frames at the range edges are joined with the neighbours before they are counted
+static void mergeVidEdge(VidStat &to, const VidFrame &f)
+{
+    if (f.no < 0)
+        return;
+
+    if (to.cur.no == f.no) {
+        to.cur.total    = std::max(to.cur.total, f.total);
+        to.cur.bits[0] |= f.bits[0];
+        to.cur.bits[1] |= f.bits[1];
+        return;
+    }
+    if (to.cur.no >= 0) {
+        finishFrame(to, to.cur);
+        to.missing += frameGap(to.cur.no, f.no);
+    }
+    to.cur = f;
+}
+
+static void mergeVid(VidStat &to, const VidStat &from)
+{
+    if (!from.headDone) {
+        mergeVidEdge(to, from.cur);
+        return;
+    }
+
+    // the head is final once it is joined, the range counted the frames after it
+    mergeVidEdge(to, from.head);
+    finishFrame(to, to.cur);
+    to.frames    += from.frames;
+    to.lossy     += from.lossy;
+    to.fragsLost += from.fragsLost;
+    to.missing   += from.missing;
+    for (int i = 0; i < 5; i++)
+        to.lostHist[i] += from.lostHist[i];
+    to.cur = from.cur;
+}
+
+static void merge(Range &to, Range &from)
+{
+    if (from.records == 0)
+        return;
+    if (to.records == 0)
+        to.firstTS = from.firstTS;
+    to.lastTS     = from.lastTS;
+    to.records   += from.records;
+    to.datagrams += from.datagrams;
+    to.frames    += from.frames;
+    to.others    += from.others;
+    to.malformed += from.malformed;
+    to.eventDrops += from.eventDrops;
+
+    for (auto &it : from.flows) {
+        Flow &flow = to.flows[it.first];
+
+        for (auto &b : it.second.bufs)
+            mergeBuf(flow.bufs[b.first], b.second);
+        for (auto &r : it.second.rtts)
+            mergeRtt(flow.rtts[r.first], r.second);
+        mergePcmd(flow.pcmd, it.second.pcmd);
+        mergeVid(flow.vid, it.second.vid);
+    }
+    to.events.insert(to.events.end(), from.events.begin(), from.events.end());
+}
+
+/*
+*****************************************************************************************
+* report
+*****************************************************************************************
+*/
+static void printHist(const u64 *hist)
+{
+    static const char *TBL_BUCKETS[IA_BUCKETS] = { "<1", "<2", "<4", "<8", "<16", "<32", "<64", "<128",
+        "<256", "<512", "<1k", "<2k", "<4k", "<8k", "<16k", ">=16k" };
+
+    for (int i = 0; i < IA_BUCKETS; i++) {
+        if (hist[i])
+            printf(" %s:%llu", TBL_BUCKETS[i], (unsigned long long)hist[i]);
+    }
+}
+
+static double pcmdPercentile(const PcmdStat &pcmd, double pct)
+{
+    u64 want = (u64)ceil(pcmd.cnt * pct);
+    u64 acc  = 0;
+
+    for (int i = 0; i <= PCMD_BINS; i++) {
+        acc += pcmd.bins[i];
+        if (acc >= want && acc > 0)
+            return i;
+    }
+    return PCMD_BINS;
+}
+
+static void report(Range &all, int threads, int ranges)
+{
+    double base = all.firstTS;
+    char   src[16], dst[16];
+
+    printf("capture  : %llu records, %llu ARNetwork datagrams, %llu frames, %llu other udp, %llu malformed\n",
+        (unsigned long long)all.records, (unsigned long long)all.datagrams, (unsigned long long)all.frames,
+        (unsigned long long)all.others, (unsigned long long)all.malformed);
+    printf("duration : %.3fs, %d threads, %d ranges\n\n", (all.lastTS - all.firstTS) / 1e6, threads, ranges);
+
+    for (auto &it : all.flows) {
+        Flow &flow = it.second;
+
+        if (flow.bufs.empty())
+            continue;
+        ipStr(it.first.src, src);
+        ipStr(it.first.dst, dst);
+        printf("flow %s -> %s\n", src, dst);
+        printf("  %3s %-12s %8s %10s %8s %8s %6s %6s  inter-arrival ms\n", "id", "buffer", "frames", "bytes", "fps", "kbps", "gaps", "dups");
+
+        for (auto &b : flow.bufs) {
+            BufStat &buf = b.second;
+            double  secs = (buf.lastTS - buf.firstTS) / 1e6;
+
+            printf("  %3d %-12s %8llu %10llu %8.1f %8.1f %6u %6u ", b.first, bufferName(b.first),
+                (unsigned long long)buf.frames, (unsigned long long)buf.bytes,
+                secs > 0 ? (buf.frames - 1) / secs : 0.0, secs > 0 ? buf.bytes * 8 / secs / 1000 : 0.0, buf.gaps, buf.dups);
+            printHist(buf.hist);
+            printf("\n");
+        }
+
+        for (auto &r : flow.rtts) {
+            RttStat &rtt = r.second;
+
+            if (rtt.cnt == 0 && rtt.unacked == 0)
+                continue;
+            printf("  %s rtt %-12s n:%llu", r.first == BUFFER_ID_PING ? "ping" : "ack ", bufferName(r.first),
+                (unsigned long long)rtt.cnt);
+            if (rtt.cnt)
+                printf(" min:%.1fms avg:%.1fms max:%.1fms", rtt.min / 1e3, (double)rtt.sum / rtt.cnt / 1e3, rtt.max / 1e3);
+            printf(" retrans:%u unacked:%u ", rtt.retrans, rtt.unacked);
+            printHist(rtt.hist);
+            printf("\n");
+        }
+
+        PcmdStat &pcmd = flow.pcmd;
+        if (pcmd.cnt) {
+            double mean = pcmd.sum / pcmd.cnt;
+            double sd   = sqrt(std::max(0.0, pcmd.sumSq / pcmd.cnt - mean * mean));
+
+            printf("  pcmd cadence   n:%llu mean:%.1fms jitter(sd):%.1fms p50:%.0fms p95:%.0fms p99:%.0fms max:%.1fms\n",
+                (unsigned long long)pcmd.cnt, mean / 1e3, sd / 1e3, pcmdPercentile(pcmd, 0.5),
+                pcmdPercentile(pcmd, 0.95), pcmdPercentile(pcmd, 0.99), pcmd.max / 1e3);
+        }
+
+        VidStat &vid = flow.vid;
+        if (vid.frames) {
+            printf("  video frames   n:%llu with loss:%llu frags lost:%llu missing frames:%llu  lost per frame 0:%llu 1:%llu 2:%llu 3-5:%llu 6+:%llu\n",
+                (unsigned long long)vid.frames, (unsigned long long)vid.lossy, (unsigned long long)vid.fragsLost,
+                (unsigned long long)vid.missing, (unsigned long long)vid.lostHist[0], (unsigned long long)vid.lostHist[1],
+                (unsigned long long)vid.lostHist[2], (unsigned long long)vid.lostHist[3], (unsigned long long)vid.lostHist[4]);
+        }
+        printf("\n");
+    }
+
+    // the same report can be seen on both legs of a bridge, only the changes are shown
+    std::stable_sort(all.events.begin(), all.events.end(), [](const Event &a, const Event &b) { return a.ts < b.ts; });
+    s32 last[3] = { -1, -1, -1 };
+
+    printf("timeline\n");
+    for (auto &ev : all.events) {
+        if (last[ev.kind] == ev.value)
+            continue;
+        last[ev.kind] = ev.value;
+
+        printf("  %9.3f ", (ev.ts - base) / 1e6);
+        switch (ev.kind) {
+            case EV_FLYING:
+                printf("flying  %s\n", ev.value < 9 ? TBL_FLYING[ev.value] : "?");
+                break;
+            case EV_ALERT:
+                printf("alert   %s\n", ev.value < 6 ? TBL_ALERT[ev.value] : "?");
+                break;
+            case EV_BATTERY:
+                printf("battery %d%%\n", ev.value);
+                break;
+        }
+    }
+    if (all.eventDrops)
+        printf("  %u events dropped\n", all.eventDrops);
+}
+
+int main(int argc, char *argv[])
+{
+    int  opt;
+    int  threads = std::thread::hardware_concurrency();
+    bool verbose = false;
+
+    while ((opt = getopt(argc, argv, "j:v")) != -1) {
+        switch (opt) {
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                fprintf(stderr, "usage : %s [-j threads] [-v] <capture>\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage : %s [-j threads] [-v] <capture>\n", argv[0]);
+        return 1;
+    }
+    threads = std::max(threads, 1);
+
+    int fd = open(argv[optind], O_RDONLY);
+    if (fd < 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    struct stat st;
+    fstat(fd, &st);
+
+    const u8 *base = (const u8*)mmap(NULL, st.st_size ? st.st_size : 1, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return 1;
+    }
+    madvise((void*)base, st.st_size, MADV_SEQUENTIAL);
+
+    Pcap pcap;
+    if (!pcap.open(base, st.st_size)) {
+        fprintf(stderr, "not a pcap file : %s\n", argv[optind]);
+        return 1;
+    }
+
+    // a few ranges per thread evens out the load, small captures stay in one
+    int cnt = std::max((u64)1, std::min((u64)threads * 4, (u64)st.st_size / SHARD_MIN_LEN));
+    std::vector<Range> ranges(cnt);
+    std::atomic<int>   next(0);
+    u64 chunk = (st.st_size + cnt - 1) / cnt;
+
+    auto worker = [&]() {
+        int idx;
+
+        while ((idx = next++) < cnt) {
+            Range &r = ranges[idx];
+
+            r.start = pcap.sync(idx * chunk);
+            r.end   = (idx == cnt - 1) ? pcap.size : pcap.sync((idx + 1) * chunk);
+            if (r.start >= r.end)
+                continue;
+
+            Decoder dec(&pcap, &r);
+            dec.run();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < std::min(threads, cnt); i++)
+        pool.push_back(std::thread(worker));
+    for (auto &t : pool)
+        t.join();
+
+    Range all;
+    for (int i = 0; i < cnt; i++) {
+        if (verbose && ranges[i].records)
+            fprintf(stderr, "range %2d : bytes %llu-%llu, %llu records, %.3fs - %.3fs\n", i,
+                (unsigned long long)ranges[i].start, (unsigned long long)ranges[i].end, (unsigned long long)ranges[i].records,
+                (ranges[i].firstTS - ranges[0].firstTS) / 1e6, (ranges[i].lastTS - ranges[0].firstTS) / 1e6);
+        merge(all, ranges[i]);
+    }
+    // the last video frame of the capture
+    for (auto &it : all.flows) {
+        if (it.second.vid.cur.no >= 0)
+            finishFrame(it.second.vid, it.second.vid.cur);
+    }
+
+    report(all, threads, cnt);
+
+    munmap((void*)base, st.st_size);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+// host side timing test of the ESP failsafe (Failsafe.cpp) as BridgeServer::kick() drives it.
+// the RC is cut at every phase against the PCMD tick, the latency is from the last good RC frame
+// (or the first one flagged failsafe) to the tick that sends LAND. exits 1 when a bound is missed
+//
+// build : g++ -O2 -I../RC2Bebop_ESP -o rbfailsafe rbfailsafe.cpp ../RC2Bebop_ESP/Failsafe.cpp
+// usage : rbfailsafe [-r rc period ms] [-p pcmd period ms] [-l loop period ms] [-v]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "Failsafe.h"
+
+#define RUN_MS          3000
+#define RESUME_MS       1000        // the RC comes back this long after the cut
+
+enum {
+    CASE_SILENT = 0,                // the AVR stops sending CMD_SET_RC
+    CASE_FLAG,                      // frames go on with RC_STATUS_FAILSAFE set
+    CASE_MAX,
+};
+
+static const char *mCaseName[CASE_MAX] = { "rc silent", "rc flag" };
+
+static struct {
+    u32     rcPeriod;
+    u32     tickPeriod;             // PCMD_PERIOD_MS in BridgeServer.cpp
+    u32     loopPeriod;             // loop() turn around
+    bool    verbose;
+} mCfg = { 20, 25, 1, false };
+
+typedef struct {
+    u32     detect;                 // ms to the first LAND
+    u32     detectTicks;
+    u32     repeatMin;              // ticks between LANDs
+    u32     repeatMax;
+    u32     lands;
+    u32     recover;                // ms from the RC back to failsafe off
+    bool    stray;                  // LAND before the cut or after recovery
+} RUN_T;
+
+typedef struct {
+    u32     min;
+    u32     max;
+    u64     sum;
+    u32     cnt;
+} STAT_T;
+
+static void statAdd(STAT_T *st, u32 v)
+{
+    if (st->cnt == 0 || v < st->min)
+        st->min = v;
+    if (v > st->max)
+        st->max = v;
+    st->sum += v;
+    st->cnt++;
+}
+
+// one cut at cutMs with the RC frames starting at rcPhase, time steps by the loop period
+static bool runOnce(u8 type, u32 rcPhase, u32 cutMs, RUN_T *run)
+{
+    Failsafe    fs;
+    u32         nextRC   = rcPhase;
+    u32         lastGood = 0;
+    u32         firstBad = 0;
+    u32         lastTick = 0;
+    u32         ticks    = 0;
+    u32         ticksCut = 0;
+    u32         lastLand = 0;
+    u32         resumeTS = cutMs + RESUME_MS;
+    bool        detected = false;
+    bool        on       = false;
+
+    memset(run, 0, sizeof(RUN_T));
+    run->repeatMin = 0xffffffff;
+    fs.setAction(Failsafe::ACTION_LAND);
+
+    for (u32 t = 0; t < cutMs + RUN_MS; t += mCfg.loopPeriod) {
+        bool alive = t < cutMs || t >= resumeTS;
+
+        // serial callback, before kick() in the same loop turn
+        while (t >= nextRC) {
+            if (alive) {
+                fs.setRCFailsafe(false);
+                fs.onRC(nextRC);
+                if (nextRC < cutMs)
+                    lastGood = nextRC;
+            } else if (type == CASE_FLAG) {
+                fs.setRCFailsafe(true);
+                fs.onRC(nextRC);
+                if (firstBad == 0)
+                    firstBad = nextRC;
+            }
+            nextRC += mCfg.rcPeriod;
+        }
+
+        if (t - lastTick < mCfg.tickPeriod)
+            continue;
+        lastTick = t;
+        ticks++;
+        if (t >= cutMs && ticksCut == 0)
+            ticksCut = ticks;
+
+        u8 send = fs.tick(t, false);
+
+        if (send == Failsafe::SEND_LAND) {
+            if (t < cutMs || (t >= resumeTS && !fs.isOn())) {
+                run->stray = true;
+            } else if (!detected) {
+                detected          = true;
+                run->detect       = t - ((type == CASE_FLAG) ? firstBad : lastGood);
+                run->detectTicks  = ticks - ticksCut + 1;
+            } else {
+                u32 gap = ticks - lastLand;
+
+                run->repeatMin = (gap < run->repeatMin) ? gap : run->repeatMin;
+                run->repeatMax = (gap > run->repeatMax) ? gap : run->repeatMax;
+            }
+            lastLand = ticks;
+            run->lands++;
+        }
+
+        if (on && !fs.isOn() && t >= resumeTS && run->recover == 0)
+            run->recover = t - resumeTS;
+        on = fs.isOn();
+    }
+
+    if (mCfg.verbose)
+        printf("%-10s rc:%3u cut:%5u detect:%4u ms %2u ticks, lands:%u, recover:%u ms%s\n", mCaseName[type], rcPhase, cutMs,
+            run->detect, run->detectTicks, run->lands, run->recover, run->stray ? " STRAY" : "");
+
+    return detected;
+}
+
+int main(int argc, char *argv[])
+{
+    int  opt;
+    int  ret = 0;
+
+    while ((opt = getopt(argc, argv, "r:p:l:v")) != -1) {
+        switch (opt) {
+            case 'r':
+                mCfg.rcPeriod = atoi(optarg);
+                break;
+            case 'p':
+                mCfg.tickPeriod = atoi(optarg);
+                break;
+            case 'l':
+                mCfg.loopPeriod = atoi(optarg);
+                break;
+            case 'v':
+                mCfg.verbose = true;
+                break;
+            default:
+                fprintf(stderr, "usage : %s [-r rc period ms] [-p pcmd period ms] [-l loop period ms] [-v]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (mCfg.rcPeriod == 0 || mCfg.tickPeriod == 0 || mCfg.loopPeriod == 0) {
+        fprintf(stderr, "periods must be > 0\n");
+        return 1;
+    }
+
+    // one tick and one loop turn on top of what has to be waited for
+    u32 bound[CASE_MAX] = {
+        RC_TIMEOUT_MS + mCfg.tickPeriod + mCfg.loopPeriod,
+        mCfg.tickPeriod + mCfg.loopPeriod,
+    };
+
+    printf("rc %u ms, tick %u ms, loop %u ms, timeout %u ms, repeat %u ticks\n\n",
+        mCfg.rcPeriod, mCfg.tickPeriod, mCfg.loopPeriod, RC_TIMEOUT_MS, FAILSAFE_REPEAT_TICKS);
+    printf("%-10s %8s %8s %8s %6s %7s %7s %8s  %s\n", "case", "min ms", "avg ms", "max ms", "ticks", "rep min", "rep max", "recover", "bound");
+
+    for (u8 type = 0; type < CASE_MAX; type++) {
+        STAT_T  detect, recover;
+        u32     ticksMax = 0;
+        u32     repMin = 0xffffffff, repMax = 0;
+        u32     runs = 0, misses = 0, strays = 0;
+
+        memset(&detect, 0, sizeof(detect));
+        memset(&recover, 0, sizeof(recover));
+
+        // every RC phase against every cut phase within one tick
+        for (u32 rcPhase = 0; rcPhase < mCfg.rcPeriod; rcPhase++) {
+            for (u32 cut = 0; cut < mCfg.tickPeriod; cut++) {
+                RUN_T run;
+
+                runs++;
+                if (!runOnce(type, rcPhase, 1000 + cut, &run)) {
+                    misses++;
+                    continue;
+                }
+                statAdd(&detect, run.detect);
+                if (run.recover)
+                    statAdd(&recover, run.recover);
+                ticksMax = (run.detectTicks > ticksMax) ? run.detectTicks : ticksMax;
+                if (run.lands > 1) {
+                    repMin = (run.repeatMin < repMin) ? run.repeatMin : repMin;
+                    repMax = (run.repeatMax > repMax) ? run.repeatMax : repMax;
+                }
+                if (run.stray)
+                    strays++;
+            }
+        }
+
+        bool fail = misses > 0 || strays > 0 || detect.max > bound[type] ||
+                    repMin != FAILSAFE_REPEAT_TICKS || repMax != FAILSAFE_REPEAT_TICKS;
+
+        printf("%-10s %8u %8.1f %8u %6u %7u %7u %8u  %u %s\n", mCaseName[type], detect.min,
+            detect.cnt ? (double)detect.sum / detect.cnt : 0.0, detect.max, ticksMax, repMin == 0xffffffff ? 0 : repMin, repMax,
+            recover.max, bound[type], fail ? "FAIL" : "ok");
+        if (misses || strays)
+            printf("%-10s %u runs, %u missed, %u stray LAND\n", "", runs, misses, strays);
+        if (fail)
+            ret = 1;
+    }
+
+    return ret;
+}
@@ -0,0 +1,329 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+// host side decoder for the ESP flight data recorder (Recorder.cpp)
+//
+// build : g++ -O2 -o rbfdr rbfdr.cpp
+// usage : rbfdr [-c] <file>      -c : csv, one record per line
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+typedef uint8_t  u8;
+typedef int8_t   s8;
+typedef uint16_t u16;
+typedef int16_t  s16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define REC_MAGIC           0x52464252
+#define REC_INDEX_MAGIC     0x58444952
+#define REC_VERSION         1
+#define REC_FILE_HDR_LEN    16
+#define REC_HDR_LEN         6
+#define REC_INDEX_LEN       24
+
+enum {
+    REC_STATE = 1,
+    REC_RC,
+    REC_PCMD,
+    REC_TELEMETRY,
+    REC_LINK,
+    REC_REPORT,
+    REC_INDEX = 0x7f,
+};
+
+static const char *TBL_STATES[] = { "INIT", "AP_CONNECT", "DISCOVERY", "DISCOVERY_ACK", "CONFIG", "WORK", "RECONNECT", "RESUME" };
+static const char *TBL_PCMD_SRC[] = { "rc", "app", "failsafe" };
+
+static bool mCSV;
+
+static u16 get16(u8 *buf) { return buf[0] | (buf[1] << 8); }
+static u32 get32(u8 *buf) { return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((u32)buf[3] << 24); }
+
+static float getFloat(u8 *buf)
+{
+    u32   v = get32(buf);
+    float f;
+
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+static double getDouble(u8 *buf)
+{
+    u64    v = get32(buf) | ((u64)get32(&buf[4]) << 32);
+    double d;
+
+    memcpy(&d, &v, sizeof(d));
+    return d;
+}
+
+// payload length a record of the type must have, -1 for variable
+static int recordLen(u8 type)
+{
+    switch (type) {
+        case REC_STATE:     return 1;
+        case REC_RC:        return 17;
+        case REC_PCMD:      return 6;
+        case REC_TELEMETRY: return 7;
+        case REC_LINK:      return 13;
+        case REC_REPORT:    return -1;
+        case REC_INDEX:     return REC_INDEX_LEN;
+    }
+    return 0;
+}
+
+static const char *recordName(u8 type)
+{
+    switch (type) {
+        case REC_STATE:     return "state";
+        case REC_RC:        return "rc";
+        case REC_PCMD:      return "pcmd";
+        case REC_TELEMETRY: return "telemetry";
+        case REC_LINK:      return "link";
+        case REC_REPORT:    return "report";
+        case REC_INDEX:     return "index";
+    }
+    return "?";
+}
+
+static void printWall(u32 epoch)
+{
+    char   str[32];
+    time_t t = epoch;
+
+    if (epoch == 0) {
+        printf(mCSV ? "" : "unknown");
+        return;
+    }
+    strftime(str, sizeof(str), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+    printf("%s", str);
+}
+
+static void printReport(u8 *data, u8 size)
+{
+    const char *sep = mCSV ? "," : " ";
+
+    if (size < 4) {
+        printf("%sshort", sep);
+        return;
+    }
+
+    u8  prj = data[0];
+    u8  cls = data[1];
+    u16 cmd = get16(&data[2]);
+
+    data += 4;
+    size -= 4;
+    printf("%s%d%s%d%s%d", sep, prj, sep, cls, sep, cmd);
+
+    // ARDrone3 PilotingState
+    if (prj == 1 && cls == 4) {
+        if (cmd == 4 && size >= 24)
+            printf(mCSV ? ",%.6f,%.6f,%.2f" : " position lat:%.6f lon:%.6f alt:%.2f",
+                getDouble(data), getDouble(&data[8]), getDouble(&data[16]));
+        else if (cmd == 5 && size >= 12)
+            printf(mCSV ? ",%.3f,%.3f,%.3f" : " speed x:%.3f y:%.3f z:%.3f",
+                getFloat(data), getFloat(&data[4]), getFloat(&data[8]));
+        else if (cmd == 6 && size >= 12)
+            printf(mCSV ? ",%.3f,%.3f,%.3f" : " attitude roll:%.3f pitch:%.3f yaw:%.3f",
+                getFloat(data), getFloat(&data[4]), getFloat(&data[8]));
+        else if (cmd == 8 && size >= 8)
+            printf(mCSV ? ",%.2f" : " altitude %.2f", getDouble(data));
+        return;
+    }
+    for (u8 i = 0; i < size; i++)
+        printf(mCSV ? ",%02x" : " %02x", data[i]);
+}
+
+static void printRecord(u8 type, u32 ms, u8 *data, u8 size)
+{
+    const char *fmt;
+
+    if (mCSV)
+        printf("%u,%s", ms, recordName(type));
+    else
+        printf("%10.3f %-9s", ms / 1000.0, recordName(type));
+
+    switch (type) {
+        case REC_STATE:
+            printf(mCSV ? ",%s" : " %s", data[0] < 8 ? TBL_STATES[data[0]] : "?");
+            break;
+
+        case REC_RC:
+            for (u8 i = 0; i < 8; i++)
+                printf(mCSV ? ",%d" : " %4d", (s16)get16(&data[i * 2]));
+            printf(mCSV ? ",%d" : "  status:%02x", data[16]);
+            break;
+
+        case REC_PCMD:
+            fmt = mCSV ? ",%s,%d,%d,%d,%d,%d" : " %-8s flag:%d roll:%4d pitch:%4d yaw:%4d gaz:%4d";
+            printf(fmt, data[0] < 3 ? TBL_PCMD_SRC[data[0]] : "?", data[1],
+                (s8)data[2], (s8)data[3], (s8)data[4], (s8)data[5]);
+            break;
+
+        case REC_TELEMETRY:
+            fmt = mCSV ? ",%d,%d,%d,%d,%d,%d,%d" : " batt:%d%% rssi:%d flying:%d alert:%d quality:%d flags:%02x apps:%d";
+            printf(fmt, data[0], (s8)data[1], data[2], data[3], data[4], data[5], data[6]);
+            break;
+
+        case REC_LINK:
+            fmt = mCSV ? ",%.1f,%.1f,%.1f,%d,%d" : " rtt:%.1fms jitter:%.1fms loss:%.1f%% rssi:%d quality:%d";
+            printf(fmt, get32(data) / 1000.0, get32(&data[4]) / 1000.0, get16(&data[8]) / 10.0,
+                (s16)get16(&data[10]), data[12]);
+            break;
+
+        case REC_REPORT:
+            printReport(data, size);
+            break;
+
+        case REC_INDEX:
+            printf(mCSV ? ",%u,%u,%u,%u," : " offset:%u prev:%u records:%u drops:%u wall:",
+                get32(&data[4]), get32(&data[8]), get32(&data[12]), get32(&data[16]));
+            printWall(get32(&data[20]));
+            break;
+    }
+    printf("\n");
+}
+
+// a valid index record starting at ofs tells its own offset
+static bool isIndexAt(u8 *buf, u32 size, u32 ofs)
+{
+    if (ofs + REC_HDR_LEN + REC_INDEX_LEN > size)
+        return false;
+
+    u8 *rec = &buf[ofs];
+    return rec[0] == REC_INDEX && rec[1] == REC_INDEX_LEN &&
+        get32(&rec[REC_HDR_LEN]) == REC_INDEX_MAGIC && get32(&rec[REC_HDR_LEN + 4]) == ofs;
+}
+
+// next index record after a torn one, size when there is none
+static u32 resync(u8 *buf, u32 size, u32 ofs)
+{
+    for (ofs++; ofs + REC_HDR_LEN + REC_INDEX_LEN <= size; ofs++) {
+        if (isIndexAt(buf, size, ofs))
+            return ofs;
+    }
+    return size;
+}
+
+static int decode(u8 *buf, u32 size)
+{
+    u32 ofs = REC_FILE_HDR_LEN;
+    u32 records = 0;
+    u32 bad = 0;
+    u32 skipped = 0;
+    u32 drops = 0;
+
+    if (size < REC_FILE_HDR_LEN || get32(buf) != REC_MAGIC) {
+        fprintf(stderr, "not a flight record (%u bytes)\n", size);
+        return -1;
+    }
+    if (buf[4] != REC_VERSION) {
+        fprintf(stderr, "unknown version %d\n", buf[4]);
+        return -1;
+    }
+    if (buf[5] >= REC_FILE_HDR_LEN)
+        ofs = buf[5];
+
+    if (!mCSV) {
+        printf("flight record v%d, opened ", buf[4]);
+        printWall(get32(&buf[8]));
+        printf("\n");
+    }
+
+    while (ofs + REC_HDR_LEN <= size) {
+        u8  *rec  = &buf[ofs];
+        u8  type  = rec[0];
+        u8  len   = rec[1];
+        int want  = recordLen(type);
+
+        bool valid = want < 0 || len == want;
+
+        // torn tail after a power loss
+        if (valid && ofs + REC_HDR_LEN + len > size)
+            break;
+
+        // garbage in the middle, go on from the next index
+        if (!valid || (type == REC_INDEX && !isIndexAt(buf, size, ofs))) {
+            u32 next = resync(buf, size, ofs);
+
+            bad++;
+            skipped += next - ofs;
+            fprintf(stderr, "bad record at %u, %u bytes skipped\n", ofs, next - ofs);
+            ofs = next;
+            continue;
+        }
+
+        if (type == REC_INDEX)
+            drops = get32(&rec[REC_HDR_LEN + 16]);
+        printRecord(type, get32(&rec[2]), &rec[REC_HDR_LEN], len);
+        records++;
+        ofs += REC_HDR_LEN + len;
+    }
+
+    if (ofs < size)
+        fprintf(stderr, "truncated record at %u, %u bytes\n", ofs, size - ofs);
+    fprintf(stderr, "%u records, %u bad (%u bytes), %u dropped on the ESP by the last index\n",
+        records, bad, skipped, drops);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c")) != -1) {
+        switch (opt) {
+            case 'c':
+                mCSV = true;
+                break;
+            default:
+                fprintf(stderr, "usage : %s [-c] <file>\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage : %s [-c] <file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[optind], "rb");
+    if (!fp) {
+        perror(argv[optind]);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    u8 *buf = (u8*)malloc(size > 0 ? size : 1);
+    if (!buf || fread(buf, 1, size, fp) != (size_t)size) {
+        fprintf(stderr, "can't read %s\n", argv[optind]);
+        fclose(fp);
+        free(buf);
+        return 1;
+    }
+    fclose(fp);
+
+    int ret = decode(buf, size);
+    free(buf);
+
+    return ret < 0 ? 1 : 0;
+}
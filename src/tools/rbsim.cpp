@@ -0,0 +1,946 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+// Bebop stand-in for bridge load tests, the drone side of the protocol on one linux box
+//  - TCP discovery, ARNetwork on the c2d / d2c ports, acks, ping / pong
+//  - states on request, flying state, battery, wifi rssi, 5Hz piloting state reports
+//  - ARStream video fragments at a given bitrate once the video is enabled
+//  - latency, jitter and loss on both directions
+//
+// build : g++ -O2 -std=c++11 -o rbsim rbsim.cpp
+// usage : rbsim [-b kbps] [-f fps] [-F frag size] [-S arstream frag size] [-m frag max] [-k ack interval]
+//               [-l latency ms] [-j jitter ms] [-L loss %]
+//               [-i report sec] [-p discovery port] [-c c2d port] [-V] [-s seed]
+//
+// the discovery answer points the controller at the c2d port of the address it connected to,
+// so for the ESP the simulator runs on x.x.x.1 of the network the ESP joins.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <queue>
+#include <vector>
+#include <algorithm>
+#include "../RC2Bebop_ESP/ARCOMMANDS_Ids.h"
+
+typedef uint8_t  u8;
+typedef int8_t   s8;
+typedef uint16_t u16;
+typedef int16_t  s16;
+typedef uint32_t u32;
+typedef int64_t  s64;
+typedef uint64_t u64;
+
+#define DISCOVERY_PORT      44444
+#define C2D_PORT            54321
+
+// ARNetwork
+#define HEADER_LEN          7
+#define FRAME_TYPE_ACK      1
+#define FRAME_TYPE_DATA     2
+#define FRAME_TYPE_DATA_LOW_LATENCY 3
+#define FRAME_TYPE_DATA_WITH_ACK    4
+#define BUFFER_ID_PING      0
+#define BUFFER_ID_PONG      1
+#define BUFFER_ID_C2D_PCMD  10
+#define BUFFER_ID_C2D_SETTINGS  11
+#define BUFFER_ID_C2D_EMERGENCY 12
+#define BUFFER_ID_C2D_VID_ACK   13
+#define BUFFER_ID_D2C_VID   125
+#define BUFFER_ID_D2C_ACK_SETTINGS  126
+#define BUFFER_ID_D2C_RPT   127
+#define ACK_ID_OFFSET       0x80
+
+#define MTU                 1472
+#define VID_FRAG_MAX_LEN    (65507 - HEADER_LEN - 5)     // one UDP datagram, IP fragments it
+#define PING_MS             1000
+#define REPORT_MS           200
+#define RSSI_MS             1000
+#define BATTERY_MS          10000
+#define ACK_RETRY_MS        150
+#define ACK_MAX_TRIES       5
+#define TAKEOFF_MS          1500
+#define LANDING_MS          2500
+#define PCMD_BINS           200     // 1ms
+
+enum {
+    FLY_LANDED = 0,
+    FLY_TAKINGOFF,
+    FLY_HOVERING,
+    FLY_FLYING,
+    FLY_LANDING,
+    FLY_EMERGENCY,
+};
+
+static const char *TBL_FLYING[] = { "landed", "takingoff", "hovering", "flying", "landing", "emergency" };
+
+static int put16(u8 *buf, u16 v) { buf[0] = v; buf[1] = v >> 8; return 2; }
+static int put32(u8 *buf, u32 v) { buf[0] = v; buf[1] = v >> 8; buf[2] = v >> 16; buf[3] = v >> 24; return 4; }
+static u16 get16(const u8 *buf) { return buf[0] | (buf[1] << 8); }
+static u32 get32(const u8 *buf) { return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((u32)buf[3] << 24); }
+
+static int putFloat(u8 *buf, float f)
+{
+    u32 v;
+
+    memcpy(&v, &f, sizeof(v));
+    return put32(buf, v);
+}
+
+static int putDouble(u8 *buf, double d)
+{
+    u64 v;
+
+    memcpy(&v, &d, sizeof(v));
+    put32(buf, (u32)v);
+    return 4 + put32(&buf[4], (u32)(v >> 32));
+}
+
+static u64 nowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+*****************************************************************************************
+* settings and counters
+*****************************************************************************************
+*/
+static struct {
+    u32     kbps;
+    u32     fps;
+    u32     fragSize;       // datagram payload, grows up to arFragSize to fit a frame in fragMax
+    u32     arFragSize;     // the discovery answer, real Bebop values by default
+    u32     fragMax;
+    int     ackInterval;
+    u32     latencyMs;
+    u32     jitterMs;
+    double  loss;
+    u32     reportSec;
+    u16     discoveryPort;
+    u16     c2dPort;
+    bool    videoOn;
+} mCfg = { 1500, 30, 1000, 65000, 4, -1, 0, 0, 0, 5, DISCOVERY_PORT, C2D_PORT, false };
+
+typedef struct {
+    u64     frames;
+    u64     bytes;
+    int     lastSeq;
+    u32     gaps;
+} RX_T;
+
+typedef struct {
+    u64     cnt;
+    u64     sum;
+    u64     min;
+    u64     max;
+} LAT_T;
+
+static struct {
+    RX_T    rx[256];
+    u64     rxDatagrams;
+    u64     rxBytes;
+    u64     txDatagrams;
+    u64     txBytes;
+    u64     dropped;        // by the loss setting, both directions
+    u64     vidFrames;
+    u64     vidFrags;
+    u64     vidBytes;
+    u64     vidCut;         // frames that did not fit in fragMax fragments
+    u64     vidAcks;
+    LAT_T   ack;            // our ACK_SETTINGS frames
+    LAT_T   ping;
+    u32     ackRetries;
+    u32     ackLost;
+    u64     pcmdLastUs;
+    u64     pcmdCnt;
+    double  pcmdSum;
+    double  pcmdSumSq;
+    u64     pcmdMax;
+    u32     pcmdBins[PCMD_BINS + 1];
+} mStat;
+
+static void addLat(LAT_T *lat, u64 us)
+{
+    if (lat->cnt == 0 || us < lat->min)
+        lat->min = us;
+    lat->max = std::max(lat->max, us);
+    lat->sum += us;
+    lat->cnt++;
+}
+
+/*
+*****************************************************************************************
+* impaired link
+*****************************************************************************************
+*/
+struct Packet {
+    u64     due;
+    u64     order;
+    bool    out;            // to the controller, else received
+    std::vector<u8> data;
+
+    bool operator<(const Packet &o) const { return due != o.due ? due > o.due : order > o.order; }
+};
+
+static std::priority_queue<Packet> mQueue;
+static u64 mOrder;
+
+static int  mUDP = -1;
+static struct sockaddr_in mCtrlAddr;
+static bool mCtrlKnown;
+
+static bool impair(bool out, const u8 *data, int size)
+{
+    if (mCfg.loss > 0 && drand48() * 100 < mCfg.loss) {
+        mStat.dropped++;
+        return true;
+    }
+    if (mCfg.latencyMs == 0 && mCfg.jitterMs == 0)
+        return false;
+
+    s64 delay = (s64)mCfg.latencyMs * 1000;
+    if (mCfg.jitterMs)
+        delay += (s64)((drand48() * 2 - 1) * mCfg.jitterMs * 1000);
+
+    Packet pkt;
+    pkt.due   = nowUs() + std::max(delay, (s64)0);
+    pkt.order = mOrder++;
+    pkt.out   = out;
+    pkt.data.assign(data, data + size);
+    mQueue.push(pkt);
+    return true;
+}
+
+static void sendRaw(const u8 *data, int size)
+{
+    if (!mCtrlKnown)
+        return;
+    if (sendto(mUDP, data, size, 0, (struct sockaddr*)&mCtrlAddr, sizeof(mCtrlAddr)) == size) {
+        mStat.txDatagrams++;
+        mStat.txBytes += size;
+    }
+}
+
+static void sendDatagram(const u8 *data, int size)
+{
+    if (!impair(true, data, size))
+        sendRaw(data, size);
+}
+
+/*
+*****************************************************************************************
+* ARNetwork
+*****************************************************************************************
+*/
+static u8 mTxSeq[256];
+
+static int buildFrame(u8 *buf, u8 type, u8 id, const u8 *payload, int size)
+{
+    buf[0] = type;
+    buf[1] = id;
+    buf[2] = mTxSeq[id]++;
+    put32(&buf[3], HEADER_LEN + size);
+    memcpy(&buf[HEADER_LEN], payload, size);
+    return HEADER_LEN + size;
+}
+
+// ACK_SETTINGS frames wait for the controller ack, resent like the drone does
+typedef struct {
+    bool    busy;
+    u8      seq;
+    u8      tries;
+    u64     firstUs;
+    u64     lastUs;
+    u16     len;
+    u8      frame[256];
+} PENDING_T;
+
+static PENDING_T mPending[32];
+
+static void sendCmd(u8 id, const u8 *cmd, int size)
+{
+    u8  buf[HEADER_LEN + 256];
+    int len;
+
+    if (id == BUFFER_ID_D2C_ACK_SETTINGS) {
+        len = buildFrame(buf, FRAME_TYPE_DATA_WITH_ACK, id, cmd, size);
+        for (int i = 0; i < 32; i++) {
+            PENDING_T *p = &mPending[i];
+
+            if (p->busy)
+                continue;
+            p->busy    = true;
+            p->seq     = buf[2];
+            p->tries   = 1;
+            p->firstUs = p->lastUs = nowUs();
+            p->len     = len;
+            memcpy(p->frame, buf, len);
+            break;
+        }
+    } else {
+        len = buildFrame(buf, FRAME_TYPE_DATA, id, cmd, size);
+    }
+    sendDatagram(buf, len);
+}
+
+static void onAck(u8 seq)
+{
+    for (int i = 0; i < 32; i++) {
+        PENDING_T *p = &mPending[i];
+
+        if (p->busy && p->seq == seq) {
+            addLat(&mStat.ack, nowUs() - p->firstUs);
+            p->busy = false;
+            return;
+        }
+    }
+}
+
+static void retryAcks(u64 us)
+{
+    for (int i = 0; i < 32; i++) {
+        PENDING_T *p = &mPending[i];
+
+        if (!p->busy || us < p->lastUs + ACK_RETRY_MS * 1000)
+            continue;
+        if (p->tries >= ACK_MAX_TRIES) {
+            mStat.ackLost++;
+            p->busy = false;
+            continue;
+        }
+        p->tries++;
+        p->lastUs = us;
+        mStat.ackRetries++;
+        sendDatagram(p->frame, p->len);
+    }
+}
+
+/*
+*****************************************************************************************
+* drone
+*****************************************************************************************
+*/
+static struct {
+    u8      flying;
+    u64     flyingUs;       // state entered
+    float   battery;
+    s8      roll;
+    s8      pitch;
+    s8      yaw;
+    s8      gaz;
+    double  alt;
+    float   heading;
+    u32     vidFrameNo;
+    u64     vidNextUs;
+    double  vidCredit;      // bytes
+    u8      pingSec[8];
+    u64     pingUs;
+} mDrone;
+
+static int cmdHeader(u8 *buf, u8 prj, u8 cls, u16 cmd)
+{
+    buf[0] = prj;
+    buf[1] = cls;
+    return 2 + put16(&buf[2], cmd);
+}
+
+static void sendFlyingState(u8 state)
+{
+    u8  buf[8];
+    int idx = cmdHeader(buf, ARCOMMANDS_ID_PROJECT_ARDRONE3, ARCOMMANDS_ID_ARDRONE3_CLASS_PILOTINGSTATE,
+        ARCOMMANDS_ID_ARDRONE3_PILOTINGSTATE_CMD_FLYINGSTATECHANGED);
+
+    if (state != mDrone.flying) {
+        printf("flying : %s\n", TBL_FLYING[state]);
+        mDrone.flying   = state;
+        mDrone.flyingUs = nowUs();
+    }
+    idx += put32(&buf[idx], state);
+    sendCmd(BUFFER_ID_D2C_ACK_SETTINGS, buf, idx);
+}
+
+static void sendBattery(void)
+{
+    u8  buf[5];
+    int idx = cmdHeader(buf, ARCOMMANDS_ID_PROJECT_COMMON, ARCOMMANDS_ID_COMMON_CLASS_COMMONSTATE,
+        ARCOMMANDS_ID_COMMON_COMMONSTATE_CMD_BATTERYSTATECHANGED);
+
+    buf[idx++] = (u8)mDrone.battery;
+    sendCmd(BUFFER_ID_D2C_ACK_SETTINGS, buf, idx);
+}
+
+static void sendVideoState(void)
+{
+    u8  buf[8];
+    int idx = cmdHeader(buf, ARCOMMANDS_ID_PROJECT_ARDRONE3, ARCOMMANDS_ID_ARDRONE3_CLASS_MEDIASTREAMINGSTATE,
+        ARCOMMANDS_ID_ARDRONE3_MEDIASTREAMINGSTATE_CMD_VIDEOENABLECHANGED);
+
+    idx += put32(&buf[idx], mCfg.videoOn ? 0 : 1);      // enabled, disabled
+    sendCmd(BUFFER_ID_D2C_ACK_SETTINGS, buf, idx);
+}
+
+static void sendAllStates(void)
+{
+    u8  buf[8];
+
+    sendBattery();
+    sendFlyingState(mDrone.flying);
+    sendVideoState();
+    sendCmd(BUFFER_ID_D2C_ACK_SETTINGS, buf, cmdHeader(buf, ARCOMMANDS_ID_PROJECT_COMMON,
+        ARCOMMANDS_ID_COMMON_CLASS_COMMONSTATE, ARCOMMANDS_ID_COMMON_COMMONSTATE_CMD_ALLSTATESCHANGED));
+}
+
+static void sendAllSettings(void)
+{
+    u8  buf[8];
+
+    sendCmd(BUFFER_ID_D2C_ACK_SETTINGS, buf, cmdHeader(buf, ARCOMMANDS_ID_PROJECT_COMMON,
+        ARCOMMANDS_ID_COMMON_CLASS_SETTINGSSTATE, ARCOMMANDS_ID_COMMON_SETTINGSSTATE_CMD_ALLSETTINGSCHANGED));
+}
+
+// 5Hz piloting state reports, the drone follows the sticks roughly
+static void sendReports(double dt)
+{
+    u8      buf[40];
+    int     idx;
+    bool    air = mDrone.flying == FLY_HOVERING || mDrone.flying == FLY_FLYING;
+    float   roll  = air ? mDrone.roll * 0.0035f : 0;     // 100% ~ 20 deg
+    float   pitch = air ? mDrone.pitch * 0.0035f : 0;
+
+    if (air) {
+        mDrone.alt     = std::max(0.5, mDrone.alt + mDrone.gaz * 0.01 * dt);
+        mDrone.heading = fmodf(mDrone.heading + mDrone.yaw * 0.02f * dt, 6.2832f);
+    } else if (mDrone.flying == FLY_TAKINGOFF) {
+        mDrone.alt = std::min(1.0, mDrone.alt + dt);
+    } else if (mDrone.flying == FLY_LANDING) {
+        mDrone.alt = std::max(0.0, mDrone.alt - 0.5 * dt);
+    }
+
+    idx = cmdHeader(buf, ARCOMMANDS_ID_PROJECT_ARDRONE3, ARCOMMANDS_ID_ARDRONE3_CLASS_PILOTINGSTATE,
+        ARCOMMANDS_ID_ARDRONE3_PILOTINGSTATE_CMD_POSITIONCHANGED);
+    idx += putDouble(&buf[idx], 500.0);      // no gps fix
+    idx += putDouble(&buf[idx], 500.0);
+    idx += putDouble(&buf[idx], 500.0);
+    sendCmd(BUFFER_ID_D2C_RPT, buf, idx);
+
+    idx = cmdHeader(buf, ARCOMMANDS_ID_PROJECT_ARDRONE3, ARCOMMANDS_ID_ARDRONE3_CLASS_PILOTINGSTATE,
+        ARCOMMANDS_ID_ARDRONE3_PILOTINGSTATE_CMD_SPEEDCHANGED);
+    idx += putFloat(&buf[idx], pitch * 5);
+    idx += putFloat(&buf[idx], roll * 5);
+    idx += putFloat(&buf[idx], air ? -mDrone.gaz * 0.01f : 0);
+    sendCmd(BUFFER_ID_D2C_RPT, buf, idx);
+
+    idx = cmdHeader(buf, ARCOMMANDS_ID_PROJECT_ARDRONE3, ARCOMMANDS_ID_ARDRONE3_CLASS_PILOTINGSTATE,
+        ARCOMMANDS_ID_ARDRONE3_PILOTINGSTATE_CMD_ATTITUDECHANGED);
+    idx += putFloat(&buf[idx], roll);
+    idx += putFloat(&buf[idx], pitch);
+    idx += putFloat(&buf[idx], mDrone.heading);
+    sendCmd(BUFFER_ID_D2C_RPT, buf, idx);
+
+    idx = cmdHeader(buf, ARCOMMANDS_ID_PROJECT_ARDRONE3, ARCOMMANDS_ID_ARDRONE3_CLASS_PILOTINGSTATE,
+        ARCOMMANDS_ID_ARDRONE3_PILOTINGSTATE_CMD_ALTITUDECHANGED);
+    idx += putDouble(&buf[idx], mDrone.alt);
+    sendCmd(BUFFER_ID_D2C_RPT, buf, idx);
+}
+
+static void sendRSSI(void)
+{
+    u8  buf[8];
+    int idx = cmdHeader(buf, ARCOMMANDS_ID_PROJECT_COMMON, ARCOMMANDS_ID_COMMON_CLASS_COMMONSTATE,
+        ARCOMMANDS_ID_COMMON_COMMONSTATE_CMD_WIFISIGNALCHANGED);
+
+    idx += put16(&buf[idx], (u16)(s16)(-45 - (int)(drand48() * 6)));
+    sendCmd(BUFFER_ID_D2C_RPT, buf, idx);
+}
+
+static void sendPing(void)
+{
+    struct timespec ts;
+    u8  buf[HEADER_LEN + 8];
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    put32(&mDrone.pingSec[0], ts.tv_sec);
+    put32(&mDrone.pingSec[4], ts.tv_nsec);
+    mDrone.pingUs = nowUs();
+    sendDatagram(buf, buildFrame(buf, FRAME_TYPE_DATA, BUFFER_ID_PING, mDrone.pingSec, 8));
+}
+
+// ARStream fragments : frameNo(2), flags, fragNo, fragPerFrame
+static void sendVideo(u64 us)
+{
+    static u8 buf[HEADER_LEN + 5 + VID_FRAG_MAX_LEN];
+    static u8 hdr[5 + VID_FRAG_MAX_LEN];
+    u32 frameLen;
+    u32 fragLen;
+    u32 frags;
+
+    if (!mCfg.videoOn || mCfg.kbps == 0 || us < mDrone.vidNextUs)
+        return;
+
+    mDrone.vidNextUs = (mDrone.vidNextUs ? mDrone.vidNextUs : us) + 1000000 / mCfg.fps;
+    mDrone.vidCredit += mCfg.kbps * 1000.0 / 8 / mCfg.fps;
+    frameLen = (u32)mDrone.vidCredit;
+    if ((mDrone.vidFrameNo % mCfg.fps) == 0)
+        frameLen *= 2;                  // I-frame, the P-frames after it pay it back
+    frameLen = std::max(frameLen, (u32)1);
+    mDrone.vidCredit -= frameLen;
+
+    // never more than the advertised fragments, bigger ones up to the advertised size as the
+    // drone does and IP fragments them, the tail is cut only past fragMax x arFragSize
+    fragLen = std::max(mCfg.fragSize, (frameLen + mCfg.fragMax - 1) / mCfg.fragMax);
+    fragLen = std::min(fragLen, mCfg.arFragSize);
+    frags   = (frameLen + fragLen - 1) / fragLen;
+    if (frags > mCfg.fragMax) {
+        frags = mCfg.fragMax;
+        mStat.vidCut++;
+    }
+
+    for (u32 i = 0; i < frags; i++) {
+        u32 len = std::min(fragLen, frameLen - i * fragLen);
+
+        put16(&hdr[0], mDrone.vidFrameNo);
+        hdr[2] = (mDrone.vidFrameNo % mCfg.fps) == 0;
+        hdr[3] = i;
+        hdr[4] = frags;
+        memset(&hdr[5], (u8)mDrone.vidFrameNo, len);
+        sendDatagram(buf, buildFrame(buf, FRAME_TYPE_DATA_LOW_LATENCY, BUFFER_ID_D2C_VID, hdr, 5 + len));
+        mStat.vidFrags++;
+        mStat.vidBytes += len;
+    }
+    mDrone.vidFrameNo++;
+    mStat.vidFrames++;
+}
+
+static void onCommand(const u8 *data, u32 size)
+{
+    if (size < 4)
+        return;
+
+    u8  prj = data[0];
+    u8  cls = data[1];
+    u16 cmd = get16(&data[2]);
+
+    if (prj == ARCOMMANDS_ID_PROJECT_ARDRONE3 && cls == ARCOMMANDS_ID_ARDRONE3_CLASS_PILOTING) {
+        switch (cmd) {
+            case ARCOMMANDS_ID_ARDRONE3_PILOTING_CMD_TAKEOFF:
+                if (mDrone.flying == FLY_LANDED)
+                    sendFlyingState(FLY_TAKINGOFF);
+                break;
+
+            case ARCOMMANDS_ID_ARDRONE3_PILOTING_CMD_LANDING:
+                if (mDrone.flying != FLY_LANDED && mDrone.flying != FLY_LANDING)
+                    sendFlyingState(FLY_LANDING);
+                break;
+
+            case ARCOMMANDS_ID_ARDRONE3_PILOTING_CMD_EMERGENCY:
+                sendFlyingState(FLY_EMERGENCY);
+                break;
+
+            case ARCOMMANDS_ID_ARDRONE3_PILOTING_CMD_PCMD:
+                if (size >= 9) {
+                    mDrone.roll  = data[5];
+                    mDrone.pitch = data[6];
+                    mDrone.yaw   = data[7];
+                    mDrone.gaz   = data[8];
+                }
+                break;
+        }
+    } else if (prj == ARCOMMANDS_ID_PROJECT_ARDRONE3 && cls == ARCOMMANDS_ID_ARDRONE3_CLASS_MEDIASTREAMING &&
+        cmd == ARCOMMANDS_ID_ARDRONE3_MEDIASTREAMING_CMD_VIDEOENABLE && size >= 5) {
+        mCfg.videoOn = data[4];
+        printf("video : %s\n", mCfg.videoOn ? "on" : "off");
+        sendVideoState();
+    } else if (prj == ARCOMMANDS_ID_PROJECT_COMMON && cls == ARCOMMANDS_ID_COMMON_CLASS_COMMON &&
+        cmd == ARCOMMANDS_ID_COMMON_COMMON_CMD_ALLSTATES) {
+        sendAllStates();
+    } else if (prj == ARCOMMANDS_ID_PROJECT_COMMON && cls == ARCOMMANDS_ID_COMMON_CLASS_SETTINGS &&
+        cmd == ARCOMMANDS_ID_COMMON_SETTINGS_CMD_ALLSETTINGS) {
+        sendAllSettings();
+    }
+}
+
+static void onPCMD(u64 us)
+{
+    if (mStat.pcmdLastUs) {
+        u64 dt = us - mStat.pcmdLastUs;
+
+        mStat.pcmdCnt++;
+        mStat.pcmdSum   += dt;
+        mStat.pcmdSumSq += (double)dt * dt;
+        mStat.pcmdMax    = std::max(mStat.pcmdMax, dt);
+        mStat.pcmdBins[std::min((u64)PCMD_BINS, dt / 1000)]++;
+    }
+    mStat.pcmdLastUs = us;
+}
+
+static void onFrame(u8 type, u8 id, u8 seq, const u8 *data, u32 size)
+{
+    RX_T *rx = &mStat.rx[id];
+    u8   buf[HEADER_LEN + 8];
+
+    if (rx->frames > 0 && (u8)(seq - rx->lastSeq) > 1 && (u8)(seq - rx->lastSeq) < 0x80)
+        rx->gaps += (u8)(seq - rx->lastSeq) - 1;
+    rx->frames++;
+    rx->bytes  += HEADER_LEN + size;
+    rx->lastSeq = seq;
+
+    if (type == FRAME_TYPE_DATA_WITH_ACK) {
+        u8 ackSeq = seq;
+        sendDatagram(buf, buildFrame(buf, FRAME_TYPE_ACK, id + ACK_ID_OFFSET, &ackSeq, 1));
+    }
+
+    if (type == FRAME_TYPE_ACK) {
+        if (id == BUFFER_ID_D2C_ACK_SETTINGS + ACK_ID_OFFSET && size >= 1)
+            onAck(data[0]);
+        return;
+    }
+
+    switch (id) {
+        case BUFFER_ID_PING:
+            if (size <= 8)
+                sendDatagram(buf, buildFrame(buf, FRAME_TYPE_DATA, BUFFER_ID_PONG, data, size));
+            break;
+
+        case BUFFER_ID_PONG:
+            if (size >= 8 && !memcmp(data, mDrone.pingSec, 8))
+                addLat(&mStat.ping, nowUs() - mDrone.pingUs);
+            break;
+
+        case BUFFER_ID_C2D_PCMD:
+            onPCMD(nowUs());
+            onCommand(data, size);
+            break;
+
+        case BUFFER_ID_C2D_SETTINGS:
+        case BUFFER_ID_C2D_EMERGENCY:
+            onCommand(data, size);
+            break;
+
+        case BUFFER_ID_C2D_VID_ACK:
+            mStat.vidAcks++;
+            break;
+    }
+}
+
+static void onDatagram(const u8 *data, int size)
+{
+    int ofs = 0;
+
+    mStat.rxDatagrams++;
+    mStat.rxBytes += size;
+    while (ofs + HEADER_LEN <= size) {
+        u32 len = get32(&data[ofs + 3]);
+
+        if (len < HEADER_LEN || ofs + len > (u32)size) {
+            printf("bad frame, %d bytes left\n", size - ofs);
+            return;
+        }
+        onFrame(data[ofs], data[ofs + 1], data[ofs + 2], &data[ofs + HEADER_LEN], len - HEADER_LEN);
+        ofs += len;
+    }
+}
+
+/*
+*****************************************************************************************
+* discovery
+*****************************************************************************************
+*/
+static int  mTcpListen = -1;
+static int  mTcpConn = -1;
+static char mTcpBuf[512];
+static int  mTcpLen;
+
+static void openSession(struct sockaddr_in *peer, int d2cPort)
+{
+    mCtrlAddr = *peer;
+    mCtrlAddr.sin_port = htons(d2cPort);
+    mCtrlKnown = true;
+    memset(mPending, 0, sizeof(mPending));
+    printf("controller %s, d2c port %d\n", inet_ntoa(peer->sin_addr), d2cPort);
+}
+
+// the request is one json object, answered once it is complete
+static void handleDiscovery(void)
+{
+    struct sockaddr_in peer;
+    socklen_t plen = sizeof(peer);
+    int n = recv(mTcpConn, &mTcpBuf[mTcpLen], sizeof(mTcpBuf) - 1 - mTcpLen, 0);
+
+    if (n <= 0) {
+        close(mTcpConn);
+        mTcpConn = -1;
+        return;
+    }
+    mTcpLen += n;
+    mTcpBuf[mTcpLen] = 0;
+    if (!strchr(mTcpBuf, '}'))
+        return;
+
+    const char *key = strstr(mTcpBuf, "\"d2c_port\"");
+    int  d2cPort = key ? atoi(strchr(key, ':') + 1) : 0;
+    char answer[256];
+
+    getpeername(mTcpConn, (struct sockaddr*)&peer, &plen);
+    sprintf(answer, "{ \"status\": %d, \"c2d_port\": %d, \"arstream_fragment_size\": %u, "
+        "\"arstream_fragment_maximum_number\": %u, \"arstream_max_ack_interval\": %d, "
+        "\"c2d_update_port\": 51, \"c2d_user_port\": 21 }", d2cPort ? 0 : -1, mCfg.c2dPort, mCfg.arFragSize,
+        mCfg.fragMax, mCfg.ackInterval);
+    send(mTcpConn, answer, strlen(answer) + 1, 0);      // the drone sends the terminating zero too
+    if (d2cPort)
+        openSession(&peer, d2cPort);
+
+    close(mTcpConn);
+    mTcpConn = -1;
+}
+
+/*
+*****************************************************************************************
+* report
+*****************************************************************************************
+*/
+static double pcmdPercentile(double pct)
+{
+    u64 want = (u64)ceil(mStat.pcmdCnt * pct);
+    u64 acc  = 0;
+
+    for (int i = 0; i <= PCMD_BINS; i++) {
+        acc += mStat.pcmdBins[i];
+        if (acc >= want && acc > 0)
+            return i;
+    }
+    return PCMD_BINS;
+}
+
+static void report(double secs)
+{
+    printf("--- %.1fs  flying:%s batt:%d%% alt:%.1fm\n", secs, TBL_FLYING[mDrone.flying], (int)mDrone.battery, mDrone.alt);
+    printf("rx     %llu datagrams %.1f kbps  pcmd:%llu settings:%llu vid acks:%llu gaps:%u\n",
+        (unsigned long long)mStat.rxDatagrams, mStat.rxBytes * 8 / secs / 1000,
+        (unsigned long long)mStat.rx[BUFFER_ID_C2D_PCMD].frames, (unsigned long long)mStat.rx[BUFFER_ID_C2D_SETTINGS].frames,
+        (unsigned long long)mStat.vidAcks, mStat.rx[BUFFER_ID_C2D_PCMD].gaps + mStat.rx[BUFFER_ID_C2D_SETTINGS].gaps);
+    printf("tx     %llu datagrams %.1f kbps  video %llu frames %llu frags %.1f kbps cut:%llu  dropped:%llu\n",
+        (unsigned long long)mStat.txDatagrams, mStat.txBytes * 8 / secs / 1000, (unsigned long long)mStat.vidFrames,
+        (unsigned long long)mStat.vidFrags, mStat.vidBytes * 8 / secs / 1000, (unsigned long long)mStat.vidCut,
+        (unsigned long long)mStat.dropped);
+    if (mStat.pcmdCnt) {
+        double mean = mStat.pcmdSum / mStat.pcmdCnt;
+        double sd   = sqrt(std::max(0.0, mStat.pcmdSumSq / mStat.pcmdCnt - mean * mean));
+
+        printf("pcmd   n:%llu mean:%.1fms jitter(sd):%.1fms p50:%.0fms p99:%.0fms max:%.1fms\n",
+            (unsigned long long)mStat.pcmdCnt, mean / 1e3, sd / 1e3, pcmdPercentile(0.5), pcmdPercentile(0.99), mStat.pcmdMax / 1e3);
+    }
+    if (mStat.ack.cnt)
+        printf("ack    n:%llu min:%.1fms avg:%.1fms max:%.1fms retries:%u lost:%u\n", (unsigned long long)mStat.ack.cnt,
+            mStat.ack.min / 1e3, (double)mStat.ack.sum / mStat.ack.cnt / 1e3, mStat.ack.max / 1e3, mStat.ackRetries, mStat.ackLost);
+    if (mStat.ping.cnt)
+        printf("ping   n:%llu min:%.1fms avg:%.1fms max:%.1fms\n", (unsigned long long)mStat.ping.cnt,
+            mStat.ping.min / 1e3, (double)mStat.ping.sum / mStat.ping.cnt / 1e3, mStat.ping.max / 1e3);
+    fflush(stdout);
+}
+
+/*
+*****************************************************************************************
+* main
+*****************************************************************************************
+*/
+static int openSocket(int type, u16 port)
+{
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd = socket(AF_INET, type, 0);
+
+    if (fd < 0)
+        return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage : %s [-b kbps] [-f fps] [-F frag size] [-S arstream frag size] [-m frag max] [-k ack interval]\n"
+        "       [-l latency ms] [-j jitter ms] [-L loss %%] [-i report sec] [-p discovery port] [-c c2d port] [-V] [-s seed]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    long seed = time(NULL);
+
+    while ((opt = getopt(argc, argv, "b:f:F:S:m:k:l:j:L:i:p:c:Vs:")) != -1) {
+        switch (opt) {
+            case 'b':   mCfg.kbps       = atoi(optarg);     break;
+            case 'f':   mCfg.fps        = std::max(atoi(optarg), 1);    break;
+            case 'F':   mCfg.fragSize   = std::min(std::max(atoi(optarg), 16), MTU - HEADER_LEN - 5);  break;
+            case 'S':   mCfg.arFragSize = std::min(std::max(atoi(optarg), 16), VID_FRAG_MAX_LEN);  break;
+            case 'm':   mCfg.fragMax    = std::min(std::max(atoi(optarg), 1), 255);   break;
+            case 'k':   mCfg.ackInterval = atoi(optarg);    break;
+            case 'l':   mCfg.latencyMs  = atoi(optarg);     break;
+            case 'j':   mCfg.jitterMs   = atoi(optarg);     break;
+            case 'L':   mCfg.loss       = atof(optarg);     break;
+            case 'i':   mCfg.reportSec  = std::max(atoi(optarg), 1);    break;
+            case 'p':   mCfg.discoveryPort = atoi(optarg);  break;
+            case 'c':   mCfg.c2dPort    = atoi(optarg);     break;
+            case 'V':   mCfg.videoOn    = true;             break;
+            case 's':   seed            = atol(optarg);     break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    srand48(seed);
+    mCfg.fragSize = std::min(mCfg.fragSize, mCfg.arFragSize);
+
+    // an I-frame is twice the average one
+    if (mCfg.kbps * 1000ULL / 8 / mCfg.fps * 2 > (u64)mCfg.fragMax * mCfg.arFragSize)
+        fprintf(stderr, "warning : %u kbps at %u fps does not fit in %u x %u bytes, frames will be cut\n",
+            mCfg.kbps, mCfg.fps, mCfg.fragMax, mCfg.arFragSize);
+
+    mUDP       = openSocket(SOCK_DGRAM, mCfg.c2dPort);
+    mTcpListen = openSocket(SOCK_STREAM, mCfg.discoveryPort);
+    if (mUDP < 0 || mTcpListen < 0 || listen(mTcpListen, 2) < 0) {
+        perror("bind");
+        return 1;
+    }
+    printf("discovery tcp:%d, c2d udp:%d, video %u kbps %u fps, latency %u ms, jitter %u ms, loss %.1f%%\n",
+        mCfg.discoveryPort, mCfg.c2dPort, mCfg.kbps, mCfg.fps, mCfg.latencyMs, mCfg.jitterMs, mCfg.loss);
+
+    mDrone.battery = 100;
+    u64 startUs   = nowUs();
+    u64 pingUs    = startUs;
+    u64 reportUs  = startUs;
+    u64 rssiUs    = startUs;
+    u64 batteryUs = startUs;
+    u64 statUs    = startUs;
+
+    for (;;) {
+        struct pollfd fds[3];
+        int  nfds = 0;
+        u64  us = nowUs();
+        int  timeout = 1;
+
+        if (mQueue.empty() && !(mCfg.videoOn && mCtrlKnown))
+            timeout = 5;
+
+        fds[nfds].fd = mUDP;        fds[nfds++].events = POLLIN;
+        fds[nfds].fd = mTcpListen;  fds[nfds++].events = POLLIN;
+        if (mTcpConn >= 0) {
+            fds[nfds].fd = mTcpConn;
+            fds[nfds++].events = POLLIN;
+        }
+        if (poll(fds, nfds, timeout) < 0 && errno != EINTR) {
+            perror("poll");
+            return 1;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept(mTcpListen, NULL, NULL);
+
+            if (fd >= 0) {
+                if (mTcpConn >= 0)
+                    close(mTcpConn);
+                mTcpConn = fd;
+                mTcpLen  = 0;
+            }
+        }
+        if (nfds > 2 && (fds[2].revents & (POLLIN | POLLHUP)))
+            handleDiscovery();
+
+        for (;;) {
+            u8  buf[65536];
+            struct sockaddr_in from;
+            socklen_t flen = sizeof(from);
+            int n = recvfrom(mUDP, buf, sizeof(buf), 0, (struct sockaddr*)&from, &flen);
+
+            if (n <= 0)
+                break;
+            if (!impair(false, buf, n))
+                onDatagram(buf, n);
+        }
+
+        us = nowUs();
+        while (!mQueue.empty() && mQueue.top().due <= us) {
+            Packet pkt = mQueue.top();
+
+            mQueue.pop();
+            if (pkt.out)
+                sendRaw(pkt.data.data(), pkt.data.size());
+            else
+                onDatagram(pkt.data.data(), pkt.data.size());
+        }
+
+        if (!mCtrlKnown)
+            continue;
+        us = nowUs();
+
+        // flying state machine
+        if (mDrone.flying == FLY_TAKINGOFF && us - mDrone.flyingUs >= TAKEOFF_MS * 1000)
+            sendFlyingState(FLY_HOVERING);
+        else if (mDrone.flying == FLY_HOVERING && (mDrone.roll || mDrone.pitch || mDrone.yaw || mDrone.gaz))
+            sendFlyingState(FLY_FLYING);
+        else if (mDrone.flying == FLY_FLYING && !(mDrone.roll || mDrone.pitch || mDrone.yaw || mDrone.gaz))
+            sendFlyingState(FLY_HOVERING);
+        else if ((mDrone.flying == FLY_LANDING && us - mDrone.flyingUs >= LANDING_MS * 1000) ||
+            (mDrone.flying == FLY_EMERGENCY && us - mDrone.flyingUs >= 1000000))
+            sendFlyingState(FLY_LANDED);
+
+        if (us - pingUs >= PING_MS * 1000) {
+            sendPing();
+            pingUs = us;
+        }
+        if (us - reportUs >= REPORT_MS * 1000) {
+            sendReports((us - reportUs) / 1e6);
+            reportUs = us;
+        }
+        if (us - rssiUs >= RSSI_MS * 1000) {
+            sendRSSI();
+            rssiUs = us;
+        }
+        if (us - batteryUs >= BATTERY_MS * 1000) {
+            mDrone.battery = std::max(0.0f, mDrone.battery - (mDrone.flying == FLY_LANDED ? 0.2f : 2.0f));
+            sendBattery();
+            batteryUs = us;
+        }
+        sendVideo(us);
+        retryAcks(us);
+
+        if (us - statUs >= mCfg.reportSec * 1000000ULL) {
+            report((us - startUs) / 1e6);
+            statUs = us;
+        }
+    }
+    return 0;
+}
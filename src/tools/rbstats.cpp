@@ -0,0 +1,163 @@
+/*
+ This project is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ see <http://www.gnu.org/licenses/>
+*/
+
+// host side decoder for the ESP stats snapshot (Stats.cpp)
+//
+// build : g++ -O2 -o rbstats rbstats.cpp
+// usage : rbstats [-i interval_sec] <esp ip> [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef int16_t  s16;
+typedef uint32_t u32;
+
+#define STATS_PORT          55000
+#define STATS_MAGIC         0x53425252
+#define STATS_VERSION       5
+#define STATS_HEADER_LEN    42
+#define STATS_SLOT_LEN      44
+
+static const char *TBL_DIRS[] = { "c2d", "d2c" };
+
+static u16 get16(u8 *buf) { return buf[0] | (buf[1] << 8); }
+static u32 get32(u8 *buf) { return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((u32)buf[3] << 24); }
+
+static const char *bufferName(u8 id)
+{
+    switch (id) {
+        case 0:     return "PING";
+        case 1:     return "PONG";
+        case 10:    return "PCMD";
+        case 11:    return "SETTINGS";
+        case 12:    return "EMERGENCY";
+        case 13:    return "VID_ACK";
+        case 125:   return "VIDEO";
+        case 126:   return "ACK_SETTINGS";
+        case 127:   return "REPORT";
+        case 0xfe:  return "ACKACK";
+    }
+    return (id & 0x80) ? "ACK" : "?";
+}
+
+static int decode(u8 *buf, int size)
+{
+    if (size < STATS_HEADER_LEN || get32(buf) != STATS_MAGIC) {
+        fprintf(stderr, "not a stats snapshot (%d bytes)\n", size);
+        return -1;
+    }
+    if (buf[4] != STATS_VERSION) {
+        fprintf(stderr, "unknown version %d\n", buf[4]);
+        return -1;
+    }
+
+    int slots = buf[5];
+    if (size < STATS_HEADER_LEN + slots * STATS_SLOT_LEN) {
+        fprintf(stderr, "short snapshot, %d slots in %d bytes\n", slots, size);
+        return -1;
+    }
+
+    printf("uptime %.1fs  malformed c2d:%u d2c:%u\n", get32(&buf[6]) / 1000.0, get32(&buf[10]), get32(&buf[14]));
+    printf("link   rtt:%.1fms jitter:%.1fms loss:%.1f%% rssi:%d quality:%d  video:%s frag loss:%.1f%%\n",
+        get32(&buf[18]) / 1000.0, get32(&buf[22]) / 1000.0, get16(&buf[26]) / 10.0, (s16)get16(&buf[28]),
+        buf[30], buf[31] ? "throttled" : "on", get16(&buf[32]) / 10.0);
+    printf("wifi   reconnects:%u resumed:%u last:%ums\n", get16(&buf[34]), get16(&buf[36]), get32(&buf[38]));
+
+    printf("%-3s %3s %-12s %10s %12s %8s %8s %8s %8s %6s %6s %6s %6s %6s %8s %8s\n",
+        "dir", "id", "buffer", "frames", "bytes", "ack", "data", "low lat", "data ack", "gaps", "dups", "stale", "late", "acks", "ack avg", "ack max");
+
+    u8 *slot = &buf[STATS_HEADER_LEN];
+    for (int i = 0; i < slots; i++, slot += STATS_SLOT_LEN) {
+        u32 frames = get32(&slot[4]);
+        u16 gaps   = get16(&slot[12]);
+        u16 acks   = get16(&slot[18]);
+        u32 sum    = get32(&slot[22]);
+
+        printf("%-3s %3d %-12s %10u %12u %8u %8u %8u %8u %6u %6u %6u %6u %6u %6.1fms %6ums",
+            TBL_DIRS[slot[0] & 1], slot[1], bufferName(slot[1]), frames, get32(&slot[8]),
+            get32(&slot[26]), get32(&slot[30]), get32(&slot[34]), get32(&slot[38]),
+            gaps, get16(&slot[14]), get16(&slot[42]), get16(&slot[16]),
+            acks, acks ? (double)sum / acks : 0.0, get16(&slot[20]));
+        if (gaps > 0)
+            printf("  loss %.1f%%", 100.0 * gaps / (frames + gaps));
+        printf("\n");
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    int interval = 0;
+
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        switch (opt) {
+            case 'i':
+                interval = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage : %s [-i interval_sec] <esp ip> [port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage : %s [-i interval_sec] <esp ip> [port]\n", argv[0]);
+        return 1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(optind + 1 < argc ? atoi(argv[optind + 1]) : STATS_PORT);
+    if (inet_pton(AF_INET, argv[optind], &addr.sin_addr) != 1) {
+        fprintf(stderr, "bad address : %s\n", argv[optind]);
+        return 1;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    struct timeval tv = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    do {
+        u8  buf[2048];
+        int size;
+
+        sendto(fd, "S", 1, 0, (struct sockaddr*)&addr, sizeof(addr));
+        size = recv(fd, buf, sizeof(buf), 0);
+        if (size < 0) {
+            fprintf(stderr, "no answer from %s\n", argv[optind]);
+        } else {
+            decode(buf, size);
+            printf("\n");
+        }
+        if (interval > 0)
+            sleep(interval);
+    } while (interval > 0);
+
+    close(fd);
+    return 0;
+}